@@ -0,0 +1,123 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/**
+bench.h
+---
+Timing harness shared by the benchmark suite (suite.c) and the draw benchmark
+(draw.c). Each benchmark is run in batches of operations, with the batch size
+picked so one batch takes at least BENCH_MIN_NS. The time per operation of
+every batch is kept, so percentiles can be reported as well as the mean.
+
+Results are printed one per line with tab separated columns, so the output of
+two commits can be diffed or loaded into anything that reads TSV:
+bench  level  ops  mean_ns  p50_ns  p90_ns  p99_ns
+Lines starting with '#' are comments. ops is the no. of operations timed,
+which depends on how fast the machine is, so compare the ns columns.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_SAMPLES (200)     /* batches timed per benchmark */
+#define BENCH_WARMUP (20)       /* batches run before timing starts */
+#define BENCH_MIN_NS (20000)    /* shortest a batch can take */
+
+/* results are added to this so the work can't be optimized out */
+static volatile unsigned long bench_sink;
+
+/*
+static double bench_now()
+---
+Gets the current time from a monotonic clock
+---
+Returns a double, time in ns
+*/
+static double bench_now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+static int bench_cmp()
+---
+Compares two doubles for qsort()
+---
+const void * a, * b: doubles to compare
+---
+Returns an int, <0 if a is smaller, >0 if b is smaller, 0 if equal
+*/
+static int bench_cmp( const void * a, const void * b )
+{
+        double x = *(const double *)a;
+	double y = *(const double *)b;
+	return ( x > y ) - ( x < y );
+}
+
+/*
+static void bench_header()
+---
+Prints the column names of the results
+*/
+static void bench_header()
+{
+        printf( "# bench\tlevel\tops\tmean_ns\tp50_ns\tp90_ns\tp99_ns\n" );
+}
+
+/*
+static void bench_run()
+---
+Times a benchmark and prints a line of results
+---
+const char * name: name of the benchmark
+const char * level: name of the level it was run on
+void (*run)( void *, unsigned int ): runs a given no. of operations
+void * ctx: passed to run
+*/
+static void bench_run( const char * name, const char * level,
+		       void (*run)( void *, unsigned int ), void * ctx )
+{
+        double samples[BENCH_SAMPLES];
+	unsigned int batch = 1;
+	double start, t, sum = 0;
+
+	/* grow the batch until it is long enough to time accurately. done
+	   twice, as the first pass runs with cold caches and stops early */
+	for ( int pass = 0; pass < 2; pass++ ) {
+                unsigned int size = 1;
+		while ( 1 ) {
+                        start = bench_now();
+			run( ctx, size );
+			if ( bench_now() - start >= BENCH_MIN_NS ||
+			     size >= ( 1u << 24 ) )
+				break;
+			size *= 2;
+		}
+		if ( size > batch )
+			batch = size;
+	}
+
+	for ( int i = 0; i < BENCH_WARMUP; i++ )
+		run( ctx, batch );
+
+	for ( int i = 0; i < BENCH_SAMPLES; i++ ) {
+                start = bench_now();
+		run( ctx, batch );
+		t = ( bench_now() - start ) / batch;
+		samples[i] = t;
+		sum += t;
+	}
+	qsort( samples, BENCH_SAMPLES, sizeof( double ), bench_cmp );
+
+	printf( "%s\t%s\t%lu\t%.1f\t%.1f\t%.1f\t%.1f\n", name, level,
+		(unsigned long)batch * BENCH_SAMPLES, sum / BENCH_SAMPLES,
+		samples[BENCH_SAMPLES / 2],
+		samples[BENCH_SAMPLES * 90 / 100],
+		samples[BENCH_SAMPLES * 99 / 100] );
+	fflush( stdout );
+}
+
+#endif //BENCH_H_
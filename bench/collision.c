@@ -0,0 +1,241 @@
+/**
+collision.c
+---
+Benchmark comparing the quarter-step collision mode against the swept
+collision mode, for both cost (time per segment) and accuracy (how often a hit
+is missed, and how far off the reported time of impact is).
+
+Each level is filled with random objects, and random segments (the distance an
+arrow travels in a frame) are swept through it. The true first hit of each
+segment is found by densely sampling the segment.
+
+Build and run with 'make bench_collision'.
+*/
+
+#include "../libs/physics.h"
+#include "../libs/structures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SEGMENTS (50000)
+#define TRUTH_SAMPLES (1024) /* samples per segment to find the true hit */
+#define MAX_SEG_LEN (64)     /* longest distance travelled in a frame (px) */
+
+/*
+static double now()
+---
+Gets the current time from a monotonic clock
+---
+Returns a double, time in seconds
+*/
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+static float frand()
+---
+Gets a random float in a given range
+---
+float lo, hi: range to use
+---
+Returns a float
+*/
+static float frand( float lo, float hi )
+{
+	return lo + ( hi - lo ) * ( rand() / (float)RAND_MAX );
+}
+
+/*
+static void make_level()
+---
+Fills a level with random objects. Thin objects are walls only a few px thick,
+which the quarter-step mode can tunnel through. Blocks are 1-3 tiles wide and
+high, so too many will fill the whole window.
+---
+struct Level * l: level to fill
+unsigned int count: no. of objects
+unsigned int thin: whether objects are thin walls or tile sized blocks
+*/
+static void make_level( struct Level * l, unsigned int count,
+			unsigned int thin )
+{
+	struct Object o;
+	float w, h;
+
+	initialize_level( l, 0, 0, 0, 0, 0, 0, 0, 0, 1 );
+	for ( unsigned int i = 0; i < count; i++ ) {
+                if ( thin ) {
+			/* horizontal or vertical wall 2-6px thick */
+                        if ( rand() % 2 ) {
+                                w = frand( 2, 6 );
+				h = frand( 32, 128 );
+			} else {
+                                w = frand( 32, 128 );
+				h = frand( 2, 6 );
+			}
+		} else {
+                        w = 32 * ( 1 + rand() % 3 );
+			h = 32 * ( 1 + rand() % 3 );
+		}
+		initialize_object( &o, frand( 0, 640 - w ), frand( h, 480 ),
+				   w, h, rand() % 5, 0, 0, 0 );
+		add_object_to_level( l, o );
+	}
+	initialize_grid( l, 20, 15 );
+}
+
+/*
+static unsigned int is_hit()
+---
+Brute force check of whether a position is inside any object or out of bounds
+---
+struct Position * p: position to check
+struct Level * l: level to check against
+---
+Returns an unsigned int, 1 if hit, 0 if not
+*/
+static unsigned int is_hit( struct Position * p, struct Level * l )
+{
+        if ( p->x <= 0 || p->x >= 640 || p->y <= 0 || p->y >= 480 )
+		return 1;
+	for ( unsigned int i = 0; i < l->index; i++ ) {
+                struct Object * o = &l->object_arr[i];
+		if ( p->x >= o->pos.x && p->x <= o->pos.x + o->dims.x &&
+		     p->y >= o->pos.y - o->dims.y && p->y <= o->pos.y )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+static float true_toi()
+---
+Finds the first hit along a segment by sampling it densely
+---
+struct Position * a, * b: start and end of the segment
+struct Level * l: level to check against
+---
+Returns a float from 0-1, or 2 if there is no hit
+*/
+static float true_toi( struct Position * a, struct Position * b,
+		       struct Level * l )
+{
+	struct Position p;
+	float t;
+	for ( int i = 1; i <= TRUTH_SAMPLES; i++ ) {
+                t = i / (float)TRUTH_SAMPLES;
+		initialize_position( &p, a->x + ( b->x - a->x ) * t,
+				     a->y + ( b->y - a->y ) * t );
+		if ( is_hit( &p, l ) )
+			return t;
+	}
+	return 2;
+}
+
+/*
+static void run()
+---
+Runs both collision modes over the same segments in a level and prints the
+results
+---
+char * name: name of the level
+struct Level * l: level to use
+*/
+static void run( char * name, struct Level * l )
+{
+	struct Position * a = malloc( SEGMENTS * sizeof( struct Position ) );
+	struct Position * b = malloc( SEGMENTS * sizeof( struct Position ) );
+	float * truth = malloc( SEGMENTS * sizeof( float ) );
+	unsigned int * steps = malloc( SEGMENTS * sizeof( unsigned int ) );
+	float * tois = malloc( SEGMENTS * sizeof( float ) );
+	unsigned int type;
+	int trig;
+	struct Position normal;
+	float len, angle;
+
+	/* random segments that start somewhere free */
+	for ( int i = 0; i < SEGMENTS; i++ ) {
+                do {
+                        initialize_position( &a[i], frand( 1, 639 ),
+					     frand( 1, 479 ) );
+		} while ( is_hit( &a[i], l ) );
+		len = frand( 0, MAX_SEG_LEN );
+		angle = frand( 0, 2 * M_PI );
+		initialize_position( &b[i], a[i].x + len * cosf( angle ),
+				     a[i].y + len * sinf( angle ) );
+		truth[i] = true_toi( &a[i], &b[i], l );
+	}
+
+	/* time each mode */
+	double start = now();
+	for ( int i = 0; i < SEGMENTS; i++ )
+                steps[i] = do_step_collision( &b[i], &a[i], l, &type,
+					      &trig );
+	double quarter_ns = ( now() - start ) / SEGMENTS * 1e9;
+
+	start = now();
+	for ( int i = 0; i < SEGMENTS; i++ )
+                tois[i] = do_swept_collision( &b[i], &a[i], l, &type,
+					      &normal, &trig );
+	double swept_ns = ( now() - start ) / SEGMENTS * 1e9;
+
+	/* compare each mode against the truth */
+	unsigned int hits = 0, q_missed = 0, s_missed = 0;
+	double q_err = 0, s_err = 0;
+	for ( int i = 0; i < SEGMENTS; i++ ) {
+                if ( truth[i] > 1 )
+			continue;
+		hits++;
+		
+		/* quarter step stops at the last step before the hit */
+		if ( steps[i] == 4 )
+			q_missed++;
+		else
+			q_err += fabsf( truth[i] - steps[i] / 4.0f );
+
+		if ( tois[i] >= 1 && truth[i] < 1 )
+			s_missed++;
+		else
+			s_err += fabsf( truth[i] - tois[i] );
+	}
+
+	printf( "%-8s %6u %8.1f %8.1f %8u %8u %10.4f %10.4f\n", name,
+		l->index, quarter_ns, swept_ns, q_missed, s_missed,
+		q_err / ( hits - q_missed ), s_err / ( hits - s_missed ) );
+
+	free( a );
+	free( b );
+	free( truth );
+	free( steps );
+	free( tois );
+}
+
+int main()
+{
+	struct Level l;
+	unsigned int counts[] = { 8, 32, 128 };
+	char name[16];
+
+	srand( 1 );
+	printf( "%d segments per level, toi error is the mean absolute error "
+		"as a fraction of the segment\n\n", SEGMENTS );
+	printf( "%-8s %6s %8s %8s %8s %8s %10s %10s\n", "level", "objs",
+		"q_ns", "swept_ns", "q_miss", "s_miss", "q_toi_err",
+		"s_toi_err" );
+	
+	for ( int thin = 0; thin < 2; thin++ ) {
+                for ( int i = 0; i < 3; i++ ) {
+                        make_level( &l, counts[i], thin );
+			snprintf( name, 16, "%s", thin ? "thin" : "blocks" );
+			run( name, &l );
+			free_level( &l );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,134 @@
+/**
+draw.c
+---
+Benchmark of drawing a full frame with draw_screen() on each shipped level,
+with a handful of arrows in flight. Needs a display, so it is kept apart from
+the headless suite (suite.c). Vsync is turned off so the time is not just the
+refresh rate.
+
+draw_screen is run with the mouse held still (the aim preview comes from the
+path cache) and with the mouse moving every frame (the preview is worked out
+again each time).
+
+Build and run with 'make bench_draw' from the root of the repo. See bench.h for
+the output format.
+*/
+
+#include "../libs/draw.h"
+#include "../libs/level.h"
+#include "../libs/physics.h"
+#include "../libs/structures.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_primitives.h>
+
+#define TICKS_BEFORE (30) /* ticks the arrows fly for before drawing */
+
+/**
+struct Ctx
+---
+Everything draw_screen() needs for a level
+---
+struct Level * l: level to draw
+struct Proj_arr * p: arrows in flight
+struct Bitmap * b: bitmaps of the game
+struct Layers * ly: baked chunks of the level's tilemaps
+struct Camera * cam: part of the level in view
+unsigned int moving: 1 to move the mouse every frame
+*/
+struct Ctx {
+        struct Level * l;
+	struct Proj_arr * p;
+	struct Bitmap * b;
+	struct Layers * ly;
+	struct Camera * cam;
+	unsigned int moving;
+};
+
+/*
+static void run_draw_screen()
+---
+Draws a given no. of frames of a level
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of frames
+*/
+static void run_draw_screen( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	struct Position mouse;
+	for ( unsigned int i = 0; i < n; i++ ) {
+                unsigned int off = c->moving ? i % 64 : 0;
+		initialize_position( &mouse, 300 + off, 200 - off );
+		draw_screen( c->l, &mouse, c->p, c->b, c->ly, c->cam, i % 60,
+			     0 );
+	}
+	bench_sink += n;
+}
+
+int main()
+{
+        struct Bitmap b;
+	struct Layers ly;
+	struct Camera cam;
+	struct Proj_arr p;
+	struct Level l;
+	struct Position mouse;
+	struct Ctx c;
+	char name[16];
+
+	al_init();
+	al_init_image_addon();
+	al_init_primitives_addon();
+	al_set_new_display_option( ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST );
+	ALLEGRO_DISPLAY * display = al_create_display( 640, 480 );
+	if ( display == NULL ) {
+                fprintf( stderr, "Could not create display!\n" );
+		return 1;
+	}
+	load_bitmaps( &b );
+	mask_bitmaps( &b );
+	if ( !initialize_proj_arr( &p, PROJ_ARR_SZ ) )
+		return 1;
+	initialize_layers( &ly );
+
+	printf( "# %d batches per benchmark, times are ns per frame\n",
+		BENCH_SAMPLES );
+	bench_header();
+
+	for ( int n = 1; n <= LAST_LEVEL; n++ ) {
+		load_level( &l, n );
+		reset_camera( &cam, &l );
+
+		/* spread of arrows part way through their flight */
+		reset_proj_arr( &p );
+		for ( int i = 0; i < 8; i++ ) {
+                        initialize_position( &mouse, 200 + i * 40, 100 + i * 20 );
+			add_to_proj_arr( &p, &mouse, l.start_pos );
+		}
+		for ( int i = 0; i < TICKS_BEFORE; i++ )
+			simulate_step( &l, &p, TIME_INC );
+
+		c.l = &l;
+		c.p = &p;
+		c.b = &b;
+		c.ly = &ly;
+		c.cam = &cam;
+		snprintf( name, 16, "%d", n );
+		c.moving = 0;
+		bench_run( "draw_screen", name, run_draw_screen, &c );
+		c.moving = 1;
+		bench_run( "draw_screen_moving", name, run_draw_screen, &c );
+
+		free_level( &l );
+		free_layers( &ly );
+	}
+
+	free_proj_arr( &p );
+	free_bitmaps( &b );
+	al_destroy_display( display );
+	return 0;
+}
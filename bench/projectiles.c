@@ -0,0 +1,156 @@
+/**
+projectiles.c
+---
+Benchmark comparing the SSE projectile kernel (advance_projectiles()) against
+the scalar fallback (advance_projectiles_scalar()) for different numbers of
+projectiles in flight. Also checks that both give exactly the same positions.
+
+Build and run with 'make bench_projectiles'.
+*/
+
+#include "../libs/physics.h"
+#include "../libs/structures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WORK (1 << 24) /* projectile updates per measurement */
+
+/*
+static double now()
+---
+Gets the current time from a monotonic clock
+---
+Returns a double, time in seconds
+*/
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+static float frand()
+---
+Gets a random float in a given range
+---
+float lo, hi: range to use
+---
+Returns a float
+*/
+static float frand( float lo, float hi )
+{
+	return lo + ( hi - lo ) * ( rand() / (float)RAND_MAX );
+}
+
+/*
+static double time_kernel()
+---
+Times one of the kernels, stepping every projectile forward each pass like
+the game does each frame
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level to use
+unsigned int simd: 1 to time advance_projectiles(), 0 for the scalar version
+---
+Returns a double, ns per projectile updated
+*/
+static double time_kernel( struct Proj_arr * p, struct Level * l,
+			   unsigned int simd )
+{
+        unsigned int passes = WORK / p->count;
+	double start = now();
+	
+	for ( unsigned int n = 0; n < passes; n++ ) {
+                if ( simd )
+			advance_projectiles( p, l );
+		else
+			advance_projectiles_scalar( p, l );
+		/* keep the times moving so the work can't be hoisted */
+		p->time[n % p->count] += TIME_INC;
+	}
+	return ( now() - start ) * 1e9 / ( (double)passes * p->count );
+}
+
+/*
+static unsigned int run()
+---
+Runs both kernels over a given number of random projectiles and prints a row
+of results
+---
+unsigned int count: number of projectiles
+struct Level * l: level to use
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int run( unsigned int count, struct Level * l )
+{
+	struct Proj_arr p;
+	unsigned int diff = 0;
+	
+	if ( !initialize_proj_arr( &p, count ) )
+		return 0;
+
+	/* nothing is removed, so the i-th one added is at index i */
+	struct Position m, s_pos;
+	initialize_position( &m, 0, 0 );
+	initialize_position( &s_pos, 0, 0 );
+	for ( unsigned int i = 0; i < count; i++ ) {
+                add_to_proj_arr( &p, &m, s_pos );
+                p.sx[i] = frand( 0, 640 );
+		p.sy[i] = frand( 0, 480 );
+		p.vx[i] = frand( -100, 100 );
+		p.vy[i] = frand( -100, 100 );
+		p.time[i] = frand( 0, 10 );
+	}
+
+	/* both kernels must agree exactly */
+	float * sx = malloc( sizeof( float ) * count * 2 );
+	float * sy = sx + count;
+	advance_projectiles_scalar( &p, l );
+	for ( unsigned int i = 0; i < count; i++ ) {
+                sx[i] = p.x[i];
+		sy[i] = p.y[i];
+	}
+	advance_projectiles( &p, l );
+	for ( unsigned int i = 0; i < count; i++ ) {
+		if ( sx[i] != p.x[i] || sy[i] != p.y[i] )
+			diff++;
+	}
+	free( sx );
+	
+	double scalar_ns = time_kernel( &p, l, 0 );
+	double simd_ns = time_kernel( &p, l, 1 );
+	
+	printf( "%8u %10.3f %10.3f %8.2fx %8u\n", count, scalar_ns, simd_ns,
+		scalar_ns / simd_ns, diff );
+	free_proj_arr( &p );
+	return 1;
+}
+
+int main()
+{
+	struct Level l;
+	unsigned int counts[] = { 32, 1024, 100000 };
+
+	srand( 1 );
+	initialize_position( &l.wind, 3, 2 );
+	initialize_position( &l.gravity, 0, 9.8 );
+	
+#ifdef __SSE__
+	printf( "kernel: SSE\n" );
+#else
+	printf( "kernel: scalar only (no SSE)\n" );
+#endif
+	printf( "%d updates per kernel, times are ns per projectile\n\n", WORK );
+	printf( "%8s %10s %10s %9s %8s\n", "projs", "scalar_ns", "simd_ns",
+		"speedup", "mismatch" );
+	
+	for ( int i = 0; i < 3; i++ ) {
+                if ( !run( counts[i], &l ) )
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,350 @@
+/**
+suite.c
+---
+Microbenchmarks of the hot functions of the game's core, run against every
+shipped level and a few synthetic levels scaled up well past what ships.
+Needs no display.
+
+The synthetic levels are written out to temporary files, so parsing and
+tilemap loading can be measured on them the same way as the shipped levels.
+Every random input is made from a fixed seed, so each run does the same work.
+
+Build and run with 'make bench' from the root of the repo. See bench.h for the
+output format.
+*/
+
+#include "../libs/level.h"
+#include "../libs/physics.h"
+#include "../libs/structures.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INPUTS (1024)       /* random inputs per benchmark, used in a cycle */
+#define MAX_SEG_LEN (64)    /* longest distance travelled in a tick (px) */
+#define SYNTH_SCALE (4)     /* synthetic tilemaps are this many times wider
+			       and higher than the shipped ones */
+
+/**
+struct Ctx
+---
+Inputs shared by every benchmark of a level
+---
+struct Level * l: level to use
+char * level_loc: level.txt file of the level
+char * tm_loc: tilemap file of the level
+unsigned int tm_rows, tm_cols: size of the tilemap in the file
+struct Position a[INPUTS]: random points in the window
+struct Position b[INPUTS]: random points near each point in a
+struct Position v[INPUTS]: random velocities
+float t[INPUTS]: random times
+*/
+struct Ctx {
+        struct Level * l;
+	char * level_loc;
+	char * tm_loc;
+	unsigned int tm_rows;
+	unsigned int tm_cols;
+	struct Position a[INPUTS];
+	struct Position b[INPUTS];
+	struct Position v[INPUTS];
+	float t[INPUTS];
+};
+
+/*
+static float frand()
+---
+Gets a random float in a given range
+---
+float lo, hi: range to use
+---
+Returns a float
+*/
+static float frand( float lo, float hi )
+{
+	return lo + ( hi - lo ) * ( rand() / (float)RAND_MAX );
+}
+
+/*
+static void run_is_collide()
+---
+Checks a batch of random points with is_collide()
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_is_collide( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	unsigned long r = 0;
+	for ( unsigned int i = 0; i < n; i++ )
+		r += is_collide( &c->a[i % INPUTS], c->l );
+	bench_sink += r;
+}
+
+/*
+static void run_step_collision()
+---
+Checks a batch of random segments with do_step_collision()
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_step_collision( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	unsigned long r = 0;
+	unsigned int type;
+	int trig;
+	for ( unsigned int i = 0; i < n; i++ ) {
+                /* do_step_collision() moves curr, so work on a copy */
+                struct Position curr = c->b[i % INPUTS];
+		r += do_step_collision( &curr, &c->a[i % INPUTS], c->l, &type,
+					&trig );
+	}
+	bench_sink += r;
+}
+
+/*
+static void run_calculate_position()
+---
+Moves a batch of random throws with calculate_position()
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_calculate_position( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	struct Position pos;
+	float r = 0;
+	for ( unsigned int i = 0; i < n; i++ ) {
+                calculate_position( &c->v[i % INPUTS], &pos, &c->a[i % INPUTS],
+				    c->l, c->t[i % INPUTS] );
+		r += pos.x;
+	}
+	bench_sink += (unsigned long)r;
+}
+
+/*
+static void run_calculate_path()
+---
+Works out a batch of uncached aim previews with calculate_path(), the
+work draw_projectile_path() does when the mouse moves
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_calculate_path( void * arg, unsigned int n )
+{
+        static struct Position pts[PATH_MAX_PTS];
+        struct Ctx * c = arg;
+	unsigned long r = 0;
+	for ( unsigned int i = 0; i < n; i++ )
+		r += calculate_path( &c->a[i % INPUTS], c->l, pts,
+				     PATH_MAX_PTS );
+	bench_sink += r;
+}
+
+/*
+static void run_get_path()
+---
+Looks up a batch of aim previews with get_path(), each of them cached
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_get_path( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	unsigned long r = 0;
+	/* few enough aims to all stay in the path cache */
+	for ( unsigned int i = 0; i < n; i++ )
+		r += get_path( &c->a[i % PATH_CACHE_SZ], c->l )->n;
+	bench_sink += r;
+}
+
+/*
+static void run_parse_level_file()
+---
+Parses and frees a level file a given no. of times
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_parse_level_file( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	struct Level l;
+	unsigned long r = 0;
+	for ( unsigned int i = 0; i < n; i++ ) {
+                parse_level_file( c->level_loc, &l, 1 );
+		r += l.index;
+		free_level( &l );
+	}
+	bench_sink += r;
+}
+
+/*
+static void run_load_tilemap()
+---
+Loads a tilemap file a given no. of times
+---
+void * arg: struct Ctx * of the level
+unsigned int n: no. of operations
+*/
+static void run_load_tilemap( void * arg, unsigned int n )
+{
+        struct Ctx * c = arg;
+	struct Tilemap tm;
+	unsigned long r = 0;
+	initialize_tilemap( &tm, c->tm_rows, c->tm_cols );
+	for ( unsigned int i = 0; i < n; i++ ) {
+                load_tilemap( c->tm_loc, &tm );
+		r += tm.map[i % tm.size];
+	}
+	free_tilemap( &tm );
+	bench_sink += r;
+}
+
+/*
+static void run_level()
+---
+Runs every benchmark against a loaded level
+---
+const char * name: name of the level
+struct Ctx * c: inputs to use, with l, level_loc and tm_loc set
+*/
+static void run_level( const char * name, struct Ctx * c )
+{
+        srand( 1 );
+	for ( int i = 0; i < INPUTS; i++ ) {
+                initialize_position( &c->a[i], frand( 0, 640 ),
+				     frand( 0, 480 ) );
+		initialize_position( &c->b[i],
+				     c->a[i].x + frand( -MAX_SEG_LEN,
+							MAX_SEG_LEN ),
+				     c->a[i].y + frand( -MAX_SEG_LEN,
+							MAX_SEG_LEN ) );
+		initialize_position( &c->v[i], frand( -100, 100 ),
+				     frand( -100, 100 ) );
+		c->t[i] = frand( 0, 10 );
+	}
+
+	bench_run( "is_collide", name, run_is_collide, c );
+	bench_run( "do_step_collision", name, run_step_collision, c );
+	bench_run( "calculate_position", name, run_calculate_position, c );
+	bench_run( "calculate_path", name, run_calculate_path, c );
+	bench_run( "get_path", name, run_get_path, c );
+	bench_run( "parse_level_file", name, run_parse_level_file, c );
+	bench_run( "load_tilemap", name, run_load_tilemap, c );
+}
+
+/*
+static unsigned int write_synth_level()
+---
+Writes a synthetic level.txt with a given no. of random objects, a mix of thin
+walls and tile sized blocks, and a tilemap file SYNTH_SCALE times the size of
+the shipped ones
+---
+char * level_loc: where to write the level file (a mkstemp() template)
+char * tm_loc: where to write the tilemap file (a mkstemp() template)
+unsigned int count: no. of objects
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int write_synth_level( char * level_loc, char * tm_loc,
+				       unsigned int count )
+{
+        int fd = mkstemp( level_loc );
+	FILE * f = fd < 0 ? NULL : fdopen( fd, "w" );
+	if ( f == NULL ) {
+                fprintf( stderr, "Could not write synthetic level!\n" );
+		return 0;
+	}
+	srand( count );
+	fprintf( f, "100,416\n512,384\n0,0\n0,100\n" );
+	for ( unsigned int i = 0; i < count; i++ ) {
+                int w, h;
+		if ( i % 2 ) {
+                        w = rand() % 2 ? 4 : 32 + rand() % 96;
+			h = w == 4 ? 32 + rand() % 96 : 4;
+		} else {
+                        w = 32 * ( 1 + rand() % 3 );
+			h = 32 * ( 1 + rand() % 3 );
+		}
+		fprintf( f, "%d,%d,%d,%d,%d\n", rand() % ( 640 - w ),
+			 h + rand() % ( 480 - h ), w, h, rand() % 5 );
+	}
+	fclose( f );
+
+	fd = mkstemp( tm_loc );
+	f = fd < 0 ? NULL : fdopen( fd, "w" );
+	if ( f == NULL ) {
+                fprintf( stderr, "Could not write synthetic tilemap!\n" );
+		return 0;
+	}
+	for ( unsigned int i = 0; i < 20 * 15 * SYNTH_SCALE * SYNTH_SCALE; i++ )
+		fputc( "0123456789ABCDEF"[rand() % 16], f );
+	fputc( '\n', f );
+	fclose( f );
+	return 1;
+}
+
+int main()
+{
+        static struct Ctx c;
+	struct Level l;
+	char name[32];
+	char level_loc[32];
+	char tm_loc[32];
+	unsigned int synth[] = { 128, 512 };
+
+	printf( "# %d batches per benchmark, times are ns per op\n",
+		BENCH_SAMPLES );
+	bench_header();
+
+	/* shipped levels, loaded the same way as the game */
+	for ( int n = 1; n <= LAST_LEVEL; n++ ) {
+		load_level( &l, n );
+
+		snprintf( name, 32, "%d", n );
+		snprintf( level_loc, 32, "levels/%d/level.txt", n );
+		snprintf( tm_loc, 32, "levels/%d/fg.txt", n );
+		c.l = &l;
+		c.level_loc = level_loc;
+		c.tm_loc = tm_loc;
+		c.tm_rows = 20;
+		c.tm_cols = 15;
+		run_level( name, &c );
+
+		free_level( &l );
+	}
+
+	/* synthetic levels */
+	for ( int i = 0; i < 2; i++ ) {
+                snprintf( level_loc, 32, "/tmp/md_levelXXXXXX" );
+		snprintf( tm_loc, 32, "/tmp/md_tilemapXXXXXX" );
+		if ( !write_synth_level( level_loc, tm_loc, synth[i] ) )
+			return 1;
+
+		parse_level_file( level_loc, &l, 1 );
+		initialize_grid( &l, 20, 15 );
+
+		snprintf( name, 32, "synth%u", synth[i] );
+		c.l = &l;
+		c.level_loc = level_loc;
+		c.tm_loc = tm_loc;
+		c.tm_rows = 20 * SYNTH_SCALE;
+		c.tm_cols = 15 * SYNTH_SCALE;
+		run_level( name, &c );
+
+		free_level( &l );
+		unlink( level_loc );
+		unlink( tm_loc );
+	}
+	return 0;
+}
@@ -10,8 +10,387 @@ keyword 'static'.
 
 #include "draw.h"
 
-/* time amount to be incremented by with each frame when drawing projectile */
-#define TIME_INC (0.0875)
+#include <string.h>
+
+/* time each phase of draw_screen() and write them to a csv, turn on with
+   -DFRAME_TIMING=1 (see toggle_timing_hud() and write_frame_timing()) */
+#ifndef FRAME_TIMING
+#define FRAME_TIMING (0)
+#endif
+
+
+/* max no. of sprites in a batch before it has to be flushed */
+#define BATCH_SZ (256)
+
+/* sprites waiting to be drawn, all from the same texture */
+static ALLEGRO_VERTEX batch[BATCH_SZ * 6];
+static ALLEGRO_BITMAP * batch_tex = NULL;
+static int batch_len = 0;
+
+/* no. of draw calls issued this frame and last frame */
+static unsigned int draw_calls = 0;
+static unsigned int last_draw_calls = 0;
+
+/*
+static void flush_batch()
+---
+Draws every sprite waiting in the batch with a single draw call. Must be called
+before anything is drawn outside the batch, or before the target bitmap
+changes, so that draw order is kept.
+---
+Returns nothing
+*/
+static void flush_batch()
+{
+        if ( batch_len > 0 ) {
+                al_draw_prim( batch, NULL, batch_tex, 0, batch_len,
+			      ALLEGRO_PRIM_TRIANGLE_LIST );
+		draw_calls++;
+	}
+	batch_len = 0;
+	batch_tex = NULL;
+}
+
+/*
+static void unbatched_draw()
+---
+Flushes the batch and counts a draw call, for anything that is drawn straight
+with allegro (lines, rectangles, etc.) instead of through the batch.
+---
+Returns nothing
+*/
+static void unbatched_draw()
+{
+        flush_batch();
+	draw_calls++;
+}
+
+/*
+static void batch_sprite()
+---
+Adds a section of a bitmap to the sprite batch. Works the same as
+al_draw_tinted_scaled_rotated_bitmap_region(), but consecutive sprites from the
+same bitmap are drawn together in one draw call. Changing bitmap flushes the
+batch.
+---
+ALLEGRO_BITMAP * tex: bitmap to draw from
+float sx, sy, sw, sh: section of the bitmap to draw
+ALLEGRO_COLOR tint: colour to tint the sprite with
+float cx, cy: point of the section to rotate around
+float dx, dy: where to draw the point (cx, cy) on the screen
+float xscale, yscale: how much to scale the section by
+float angle: angle to rotate by (in rad)
+int flags: ALLEGRO_FLIP_HORIZONTAL and/or ALLEGRO_FLIP_VERTICAL
+---
+Returns nothing
+*/
+static void batch_sprite( ALLEGRO_BITMAP * tex, float sx, float sy,
+			  float sw, float sh, ALLEGRO_COLOR tint,
+			  float cx, float cy, float dx, float dy,
+			  float xscale, float yscale, float angle, int flags )
+{
+	if ( tex == NULL )
+		return;
+	
+        if ( tex != batch_tex || batch_len == BATCH_SZ * 6 ) {
+		flush_batch();
+		batch_tex = tex;
+	}
+	
+	/* corners of the section before rotating, relative to (cx, cy) */
+	float x0 = -cx * xscale;
+	float y0 = -cy * yscale;
+	float x1 = ( sw - cx ) * xscale;
+	float y1 = ( sh - cy ) * yscale;
+
+	/* texture co-ords of each edge, swapped if flipped */
+	float u0 = sx, u1 = sx + sw;
+	float v0 = sy, v1 = sy + sh;
+	float tmp;
+	if ( flags & ALLEGRO_FLIP_HORIZONTAL ) {
+                tmp = u0; u0 = u1; u1 = tmp;
+	}
+	if ( flags & ALLEGRO_FLIP_VERTICAL ) {
+                tmp = v0; v0 = v1; v1 = tmp;
+	}
+
+	float c = 1, s = 0;
+	if ( angle != 0 ) {
+                c = cosf( angle );
+		s = sinf( angle );
+	}
+
+	/* top left, top right, bottom right, bottom left */
+	float lx[4] = { x0, x1, x1, x0 };
+	float ly[4] = { y0, y0, y1, y1 };
+	float lu[4] = { u0, u1, u1, u0 };
+	float lv[4] = { v0, v0, v1, v1 };
+	ALLEGRO_VERTEX quad[4];
+	for ( int i = 0; i < 4; i++ ) {
+                quad[i].x = dx + lx[i] * c - ly[i] * s;
+		quad[i].y = dy + lx[i] * s + ly[i] * c;
+		quad[i].z = 0;
+		quad[i].u = lu[i];
+		quad[i].v = lv[i];
+		quad[i].color = tint;
+	}
+
+	/* two triangles per sprite */
+	batch[batch_len++] = quad[0];
+	batch[batch_len++] = quad[1];
+	batch[batch_len++] = quad[2];
+	batch[batch_len++] = quad[0];
+	batch[batch_len++] = quad[2];
+	batch[batch_len++] = quad[3];
+}
+
+/*
+static void batch_scaled()
+---
+Adds a section of a bitmap to the sprite batch, scaled to a given size. Works
+the same as al_draw_scaled_bitmap().
+---
+ALLEGRO_BITMAP * tex: bitmap to draw from
+float sx, sy, sw, sh: section of the bitmap to draw
+float dx, dy, dw, dh: where to draw on the screen and at what size
+int flags: ALLEGRO_FLIP_HORIZONTAL and/or ALLEGRO_FLIP_VERTICAL
+---
+Returns nothing
+*/
+static void batch_scaled( ALLEGRO_BITMAP * tex, float sx, float sy,
+			  float sw, float sh, float dx, float dy,
+			  float dw, float dh, int flags )
+{
+        batch_sprite( tex, sx, sy, sw, sh, al_map_rgb_f( 1, 1, 1 ), 0, 0,
+		      dx, dy, dw / sw, dh / sh, 0, flags );
+}
+
+/*
+static void batch_bitmap()
+---
+Adds a whole bitmap to the sprite batch, tinted with a given colour. Works the
+same as al_draw_tinted_bitmap().
+---
+ALLEGRO_BITMAP * tex: bitmap to draw
+ALLEGRO_COLOR tint: colour to tint the bitmap with
+float dx, dy: where to draw on the screen
+---
+Returns nothing
+*/
+static void batch_bitmap( ALLEGRO_BITMAP * tex, ALLEGRO_COLOR tint,
+			  float dx, float dy )
+{
+	if ( tex == NULL )
+		return;
+	
+	float w = al_get_bitmap_width( tex );
+	float h = al_get_bitmap_height( tex );
+        batch_sprite( tex, 0, 0, w, h, tint, 0, 0, dx, dy, 1, 1, 0, 0 );
+}
+
+/*
+unsigned int get_draw_calls()
+---
+Gets the no. of draw calls issued to draw the last frame
+---
+Returns an unsigned int
+*/
+unsigned int get_draw_calls()
+{
+        return last_draw_calls;
+}
+
+/*
+static void end_frame()
+---
+Flushes anything left in the batch, flips the display and starts counting draw
+calls for the next frame.
+---
+Returns nothing
+*/
+static void end_frame()
+{
+        flush_batch();
+	al_flip_display();
+	last_draw_calls = draw_calls;
+	draw_calls = 0;
+}
+
+/* phases of draw_screen() timed when FRAME_TIMING is set */
+#define PHASE_BG (0)
+#define PHASE_TARGET (1)
+#define PHASE_CHAR (2)
+#define PHASE_WATER (3)
+#define PHASE_PATH (4)
+#define PHASE_PROJ (5)
+#define PHASE_FG (6) /* fg and dec, baked into one layer */
+#define PHASE_STATS (7)
+#define PHASE_FLIP (8)
+#define N_PHASES (9)
+
+#if FRAME_TIMING
+/* no. of frames kept, written to TIMING_CSV each time it fills (10s) */
+#define TIMING_FRAMES (600)
+/* no. of frames averaged over for the overlay */
+#define HUD_FRAMES (60)
+#define TIMING_CSV "frame_timing.csv"
+
+static const char * phase_names[N_PHASES] = {
+        "bg", "target", "char", "water", "path", "proj", "fg+dec", "stats",
+	"flip"
+};
+
+/* time spent in each phase (ms) of the last TIMING_FRAMES frames */
+static double phase_ms[TIMING_FRAMES][N_PHASES];
+static unsigned int timing_slot = 0;     //row of the frame being timed
+static unsigned long timed_frames = 0;   //no. of frames timed so far
+static unsigned long dumped_frames = 0;  //no. of frames written to the csv
+static double phase_start;               //when the current phase started
+static unsigned int timing_hud = 0;      //whether the overlay is shown
+
+/*
+static void start_phases()
+---
+Starts timing the first phase of a frame
+---
+Returns nothing
+*/
+static void start_phases()
+{
+        phase_start = al_get_time();
+}
+
+/*
+static void end_phase()
+---
+Ends the current phase of the frame and starts timing the next one. Flushes
+the batch first, so sprites are counted in the phase that added them rather
+than whichever phase next changes bitmap.
+---
+int phase: phase that just finished
+---
+Returns nothing
+*/
+static void end_phase( int phase )
+{
+        flush_batch();
+	double t = al_get_time();
+	phase_ms[timing_slot][phase] = ( t - phase_start ) * 1000;
+	phase_start = t;
+}
+
+/*
+static void write_timing_rows()
+---
+Appends the frames timed since the last write to TIMING_CSV, creating it (and
+writing the header) on the first write of the game
+---
+unsigned int rows: no. of rows of phase_ms to write, from the start
+---
+Returns nothing
+*/
+static void write_timing_rows( unsigned int rows )
+{
+        FILE * f = fopen( TIMING_CSV, dumped_frames == 0 ? "w" : "a" );
+	if ( f == NULL ) {
+                fprintf( stderr, "Could not write %s!\n", TIMING_CSV );
+		return;
+	}
+	if ( dumped_frames == 0 ) {
+                fprintf( f, "frame" );
+		for ( int p = 0; p < N_PHASES; p++ )
+			fprintf( f, ",%s", phase_names[p] );
+		fprintf( f, ",total\n" );
+	}
+	for ( unsigned int r = 0; r < rows; r++ ) {
+                double total = 0;
+		fprintf( f, "%lu", dumped_frames++ );
+		for ( int p = 0; p < N_PHASES; p++ ) {
+                        fprintf( f, ",%.4f", phase_ms[r][p] );
+			total += phase_ms[r][p];
+		}
+		fprintf( f, ",%.4f\n", total );
+	}
+	fclose( f );
+}
+
+/*
+static void end_timed_frame()
+---
+Moves on to the next row of phase_ms, writing every row out once they are all
+used
+---
+Returns nothing
+*/
+static void end_timed_frame()
+{
+        timed_frames++;
+	if ( ++timing_slot == TIMING_FRAMES ) {
+                write_timing_rows( TIMING_FRAMES );
+		timing_slot = 0;
+	}
+}
+
+#define START_PHASES() start_phases()
+#define END_PHASE( p ) end_phase( p )
+#define END_TIMED_FRAME() end_timed_frame()
+#else
+#define START_PHASES()
+#define END_PHASE( p )
+#define END_TIMED_FRAME()
+#endif
+
+/*
+void toggle_timing_hud()
+---
+Shows or hides the frame timing overlay. Does nothing unless built with
+FRAME_TIMING.
+---
+Returns nothing
+*/
+void toggle_timing_hud()
+{
+#if FRAME_TIMING
+        timing_hud = !timing_hud;
+#endif
+}
+
+/*
+unsigned int is_animated()
+---
+Checks if the game screen changes from frame to frame on its own, with nothing
+in the level moving. The water of the alt tilemap levels flows, and the frame
+timing overlay (if shown) updates every frame.
+---
+struct Level * l: level being played
+---
+Returns an unsigned int, 1 if animated, 0 if not
+*/
+unsigned int is_animated( struct Level * l )
+{
+#if FRAME_TIMING
+        if ( timing_hud )
+		return 1;
+#endif
+	/* same check as draw_screen() uses for the water */
+	return l->level > 7;
+}
+
+/*
+void write_frame_timing()
+---
+Writes any frames timed since TIMING_CSV was last written to it. Does nothing
+unless built with FRAME_TIMING.
+---
+Returns nothing
+*/
+void write_frame_timing()
+{
+#if FRAME_TIMING
+        write_timing_rows( timing_slot );
+	timing_slot = 0;
+#endif
+}
 
 /*
 static void draw_tile()
@@ -34,60 +413,258 @@ static void draw_tile( ALLEGRO_BITMAP* ts, int tile, int x, int y,
         if ( tile != 16 ) {
                 tx = tile * 8;
 		ty *= 8;
-                al_draw_scaled_bitmap(ts, tx, ty, 8, 8, x, y, 32, 32, 0);
+                batch_scaled(ts, tx, ty, 8, 8, x, y, 32, 32, 0);
 	}
 }
 
 /*
-int chtoi()
+void draw_tilemap()
 ---
-Converts a given character to integer.
+Draws the tiles of a given tilemap in a block of tiles, each where it is in
+the level
 ---
-char ch: character to convert
+struct Tilemap * tm: tilemap to draw
+int x0, y0, x1, y1: first and last (exclusive) tile across and down to draw,
+                    clamped to the tilemap
+ALLEGRO_BITMAP * ts: bitmap to use, passed to draw_tile()
+unsigned int ty: tileset to use from bitmap, passed to draw_tile()
 ---
-Returns an integer
+Returns nothing
 */
-static int chtoi( char ch )
+static void draw_tilemap( struct Tilemap * tm, int x0, int y0, int x1, int y1,
+			  ALLEGRO_BITMAP* ts, unsigned int ty)
 {
-        if (ch >= '0' && ch <= '9')
-                return ch - '0';
-        if (ch >= 'A' && ch <= 'F')
-                return ch - 'A' + 10;
-	else
-		return 16;
+	if ( x0 < 0 )
+		x0 = 0;
+	if ( y0 < 0 )
+		y0 = 0;
+	if ( x1 > (int)tm->rows )
+		x1 = tm->rows;
+	if ( y1 > (int)tm->cols )
+		y1 = tm->cols;
+	
+        for (int col = y0; col < y1; col++) {
+                for (int row = x0; row < x1; row++) {
+			/* already a tile index, see load_tilemap() */
+                        draw_tile( ts, tm->map[col * tm->rows + row],
+				   row*32, col*32, ty );
+		}
+	}       
 }
 
 /*
-void draw_tilemap()
+static ALLEGRO_BITMAP * bake_tilemaps()
 ---
-Draws a given tilemap onto the screen
+Pre-renders a chunk of one or more tilemaps into a single off-screen bitmap.
+Tilemaps are drawn in the order given, so later ones are overlayed on earlier
+ones.
 ---
-char map[]: tilemap to draw
-int rows, cols: no. of rows and columns the tilemap has
-ALLEGRO_BITMAP * ts: bitmap to use, passed to draw_tile()
-unsigned int ty: tileset to use from bitmap, passed to draw_tile()
+struct Tilemap * tms[]: tilemaps to bake
+unsigned int tys[]: tileset to use for each tilemap, passed to draw_tile()
+int n: no. of tilemaps
+ALLEGRO_BITMAP * ts: tileset bitmap
+int cx, cy: chunk to bake
 ---
-Returns nothing
+Returns the baked bitmap, NULL on fail
 */
-static void draw_tilemap( char map[], int rows, int cols, ALLEGRO_BITMAP* ts,
-		   unsigned int ty)
+static ALLEGRO_BITMAP * bake_tilemaps( struct Tilemap * tms[],
+				       unsigned int tys[], int n,
+				       ALLEGRO_BITMAP * ts, int cx, int cy )
 {
-	int ch;
-	int index = 0;
-	
-        for (int col = 0; col < cols; col++) {
-                for (int row = 0; row < rows; row++) {
-			
-			/* turns hex string to int */
-                        ch = chtoi( map[index++] );
-                        draw_tile( ts, ch, row*32, col*32, ty );
+	ALLEGRO_BITMAP * prev = al_get_target_bitmap();
+	ALLEGRO_TRANSFORM t;
+	int x0 = cx * CHUNK_TILES;
+	int y0 = cy * CHUNK_TILES;
+	int w = tms[0]->rows - x0 < CHUNK_TILES ? tms[0]->rows - x0
+		: CHUNK_TILES;
+	int h = tms[0]->cols - y0 < CHUNK_TILES ? tms[0]->cols - y0
+		: CHUNK_TILES;
+	ALLEGRO_BITMAP * baked = al_create_bitmap( w * 32, h * 32 );
+	if ( baked == NULL ) {
+                fprintf( stderr, "Could not create layer bitmap!\n" );
+		return NULL;
+	}
+
+	/* draw onto the new bitmap instead of the screen, moved so the
+	   chunk's first tile is in its corner */
+	flush_batch();
+	al_set_target_bitmap( baked );
+	al_identity_transform( &t );
+	al_translate_transform( &t, -x0 * 32, -y0 * 32 );
+	al_use_transform( &t );
+	al_clear_to_color( al_map_rgba( 0, 0, 0, 0 ) );
+	for ( int i = 0; i < n; i++ ) {
+                draw_tilemap( tms[i], x0, y0, x0 + w, y0 + h, ts, tys[i] );
+	}
+	flush_batch();
+	al_set_target_bitmap( prev );
+
+	return baked;
+}
+
+/*
+static void free_chunk()
+---
+Frees the baked bitmaps of a chunk and marks its slot unused
+---
+struct Chunk * c: chunk to free
+*/
+static void free_chunk( struct Chunk * c )
+{
+	if ( c->back != NULL )
+		al_destroy_bitmap( c->back );
+	if ( c->front != NULL )
+		al_destroy_bitmap( c->front );
+	c->back = NULL;
+	c->front = NULL;
+	c->cx = -1;
+	c->cy = -1;
+	c->last_used = 0;
+}
+
+/*
+static struct Chunk * get_chunk()
+---
+Gets a baked chunk of a level's tilemaps, baking it in place of the least
+recently drawn chunk if it isn't baked yet. The bg tilemap is baked on its
+own, while fg and dec are baked together as nothing is drawn between them.
+---
+struct Layers * ly: baked chunks
+struct Level * l: level with the tilemaps to bake
+ALLEGRO_BITMAP * ts: tileset bitmap
+int cx, cy: chunk to get
+---
+Returns a struct Chunk *, the chunk (its bitmaps are NULL if baking failed)
+*/
+static struct Chunk * get_chunk( struct Layers * ly, struct Level * l,
+				 ALLEGRO_BITMAP * ts, int cx, int cy )
+{
+	struct Chunk * lru = &ly->chunks[0];
+
+	for ( int i = 0; i < CHUNK_CACHE_SZ; i++ ) {
+                struct Chunk * c = &ly->chunks[i];
+		if ( c->cx == cx && c->cy == cy ) {
+                        c->last_used = ly->clock;
+			return c;
 		}
-	}       
+		if ( c->last_used < lru->last_used )
+			lru = c;
+	}
+
+	/* if alt tilemap */
+	unsigned int offset = 0;
+	if ( l->level > 7 )
+		offset = 3;
+
+	struct Tilemap * back[] = { &l->bg };
+	unsigned int back_ty[] = { 0 + offset };
+	struct Tilemap * front[] = { &l->fg, &l->dec };
+	unsigned int front_ty[] = { 1 + offset, 2 + offset };
+
+	free_chunk( lru );
+	lru->back = bake_tilemaps( back, back_ty, 1, ts, cx, cy );
+	lru->front = bake_tilemaps( front, front_ty, 2, ts, cx, cy );
+	lru->cx = cx;
+	lru->cy = cy;
+	lru->last_used = ly->clock;
+	return lru;
+}
+
+/*
+static void draw_layer()
+---
+Draws the back or front layer of every chunk in view, baking any chunk not
+baked yet. A chunk that failed to bake is drawn a tile at a time instead.
+---
+struct Layers * ly: baked chunks
+struct Level * l: level to draw
+ALLEGRO_BITMAP * ts: tileset bitmap
+struct Camera * cam: part of the level in view
+unsigned int front: 1 for the front layer (fg and dec), 0 for the back (bg)
+*/
+static void draw_layer( struct Layers * ly, struct Level * l,
+			ALLEGRO_BITMAP * ts, struct Camera * cam,
+			unsigned int front )
+{
+	int chunk_px = CHUNK_TILES * 32;
+	int cx0 = cam->x / chunk_px;
+	int cy0 = cam->y / chunk_px;
+	int cx1 = ( cam->x + VIEW_W - 1 ) / chunk_px;
+	int cy1 = ( cam->y + VIEW_H - 1 ) / chunk_px;
+	int offset = l->level > 7 ? 3 : 0;
+
+	if ( l->fg.size == 0 )
+		return;
+
+	/* clamp to the level */
+	if ( cx0 < 0 )
+		cx0 = 0;
+	if ( cy0 < 0 )
+		cy0 = 0;
+	if ( cx1 > ( (int)l->fg.rows - 1 ) / CHUNK_TILES )
+		cx1 = ( (int)l->fg.rows - 1 ) / CHUNK_TILES;
+	if ( cy1 > ( (int)l->fg.cols - 1 ) / CHUNK_TILES )
+		cy1 = ( (int)l->fg.cols - 1 ) / CHUNK_TILES;
+
+	for ( int cy = cy0; cy <= cy1; cy++ ) {
+                for ( int cx = cx0; cx <= cx1; cx++ ) {
+                        struct Chunk * c = get_chunk( ly, l, ts, cx, cy );
+			ALLEGRO_BITMAP * bmp = front ? c->front : c->back;
+			int x0 = cx * CHUNK_TILES;
+			int y0 = cy * CHUNK_TILES;
+
+			if ( bmp != NULL ) {
+                                batch_bitmap( bmp, al_map_rgb_f( 1, 1, 1 ),
+					      x0 * 32, y0 * 32 );
+			} else if ( front ) {
+                                draw_tilemap( &l->fg, x0, y0, x0 + CHUNK_TILES,
+					      y0 + CHUNK_TILES, ts, 1 + offset );
+				draw_tilemap( &l->dec, x0, y0, x0 + CHUNK_TILES,
+					      y0 + CHUNK_TILES, ts, 2 + offset );
+			} else {
+                                draw_tilemap( &l->bg, x0, y0, x0 + CHUNK_TILES,
+					      y0 + CHUNK_TILES, ts, 0 + offset );
+			}
+		}
+	}
+}
+
+/*
+void initialize_layers()
+---
+Initializes a given struct Layers with no chunks baked
+---
+struct Layers * ly: struct to initialize
+*/
+void initialize_layers( struct Layers * ly )
+{
+	for ( int i = 0; i < CHUNK_CACHE_SZ; i++ ) {
+                ly->chunks[i].back = NULL;
+		ly->chunks[i].front = NULL;
+		ly->chunks[i].cx = -1;
+		ly->chunks[i].cy = -1;
+		ly->chunks[i].last_used = 0;
+	}
+	ly->clock = 0;
+}
+
+/*
+void free_layers()
+---
+Frees the baked chunks in struct Layers, leaving it empty. Must be called when
+the level or its tilemaps change, so the chunks are baked again.
+---
+struct Layers * ly: struct to free
+*/
+void free_layers( struct Layers * ly )
+{
+	for ( int i = 0; i < CHUNK_CACHE_SZ; i++ )
+		free_chunk( &ly->chunks[i] );
 }
 
 static void draw_target( ALLEGRO_BITMAP * target, float x, float y )
 {
-        al_draw_scaled_bitmap( target, 0, 0, 15, 13, x, y, 30, 26, 0 );
+        batch_scaled( target, 0, 0, 15, 13, x, y, 30, 26, 0 );
 }
 
 /*
@@ -129,66 +706,86 @@ static void draw_character( ALLEGRO_BITMAP * player, ALLEGRO_BITMAP * bow,
 	int dx = l->start_pos.x + x_off;
 	int dy = l->start_pos.y + y_off;
 
-	al_draw_scaled_rotated_bitmap(bow, cx, cy, dx, dy, 2, 2, angle, flags);
-	al_draw_scaled_bitmap(player, 0, 0, 26, 40,
-			      l->start_pos.x-26, l->start_pos.y-80, 52, 80, flags);
+	batch_sprite(bow, 0, 0, al_get_bitmap_width(bow),
+		     al_get_bitmap_height(bow), al_map_rgb_f(1, 1, 1),
+		     cx, cy, dx, dy, 2, 2, angle, flags);
+	batch_scaled(player, 0, 0, 26, 40,
+		     l->start_pos.x-26, l->start_pos.y-80, 52, 80, flags);
 }
 
+/* aim preview styles, pick one with -DPATH_STYLE=... */
+#define PATH_DASHED (0) /* every fourth segment */
+#define PATH_SOLID (1)  /* every segment */
+#define PATH_FADE (2)   /* every fourth segment, fading out along the path */
+
+#ifndef PATH_STYLE
+#define PATH_STYLE (PATH_DASHED)
+#endif
+
+/* vertices of the aim preview, two triangles per segment */
+static ALLEGRO_VERTEX path_vtx[PATH_MAX_PTS * 6];
+
+/*
+void draw_projectile_path()
+---
+Draws the aim preview of a throw towards the mouse in the style picked by
+PATH_STYLE. Every segment is put into one vertex array as a thin quad, so the
+whole preview is a single draw call. The path comes from the level's path
+cache, so it is only recalculated when the aim changes.
+---
+struct Position * mouse: position the throw is aimed at
+struct Level * l: level the throw is in
+*/
 static void draw_projectile_path( struct Position * mouse, struct Level * l )
 {
-	//get start pos of throw from level
+	struct Path * path = get_path( mouse, l );
+	if ( path == NULL )
+		return;
 
-	//defensive copy of start position
-	struct Position pos;
-        initialize_position( &pos, l->start_pos.x, l->start_pos.y );
-	
-        if ( mouse->x < (l->start_pos.x+13) ) {
-		pos.x -= 50;
-		pos.y -=50;
-	} else {
-                pos.x += 50;
-		pos.y -=50;
-	}
+	int step = ( PATH_STYLE == PATH_SOLID ) ? 1 : 4;
+	float half = 1; /* half the width of the line */
+	int len = 0;
+	struct Position * a, * b;
+	float dx, dy, d, nx, ny, alpha;
+	ALLEGRO_COLOR col = al_map_rgb_f( 1, 0, 0 );
 
-	//calculate component velocity from mouse pos
-	struct Position velocity;
-	get_velocity_from_mouse( &velocity, &pos, mouse );
+	for ( unsigned int i = 0; i + 1 < path->n; i += step ) {
+                a = &path->pts[i];
+		b = &path->pts[i+1];
+		dx = b->x - a->x;
+		dy = b->y - a->y;
+		d = sqrtf( dx*dx + dy*dy );
+		if ( d == 0 )
+			continue;
 
-	unsigned int index = 0;
-	float time = 0;
-	float step_x, step_y;
-	unsigned int type = 0;//ignored for this, rebounds and jumps ignored
-	
-	//starting position
-	struct Position s_pos;
-	initialize_position( &s_pos, pos.x, pos.y );
-
-        struct Position prev_pos;
-	initialize_position( &prev_pos, pos.x, pos.y );
-
-	unsigned int last_coll = 4;
-        while ( last_coll > 0 ) {
-                //calculate new position and increment time
-		calculate_position( &velocity, &pos, &s_pos, l, time );
-		//calculate how far the throw is allowed to go
-		last_coll = do_step_collision( &pos, &prev_pos, l, &type );
-                
-		step_x = ( pos.x - prev_pos.x ) / 4;
-		step_y = ( pos.y - prev_pos.y ) / 4;
-
-                //fix position of throw to stop it from being inside a wall
-		pos.x = prev_pos.x + step_x * last_coll;
-		pos.y = prev_pos.y + step_y * last_coll;
-		
-		time = time + TIME_INC;
-
-                if(index%4==0){
-			al_draw_line( prev_pos.x, prev_pos.y, pos.x,
-				      pos.y, al_map_rgb_f( 1, 0, 0 ), 2 );
+		/* offset each end sideways to give the line its width */
+		nx = -dy / d * half;
+		ny = dx / d * half;
+
+		/* colours are premultiplied, so fade every component */
+		if ( PATH_STYLE == PATH_FADE ) {
+                        alpha = 1 - (float)i / path->n;
+			col = al_map_rgba_f( alpha, 0, 0, alpha );
 		}
-		prev_pos.x = pos.x;
-		prev_pos.y = pos.y;
-		index++;
+
+		ALLEGRO_VERTEX quad[4] = {
+			{ a->x + nx, a->y + ny, 0, 0, 0, col },
+			{ b->x + nx, b->y + ny, 0, 0, 0, col },
+			{ b->x - nx, b->y - ny, 0, 0, 0, col },
+			{ a->x - nx, a->y - ny, 0, 0, 0, col },
+		};
+		path_vtx[len++] = quad[0];
+		path_vtx[len++] = quad[1];
+		path_vtx[len++] = quad[2];
+		path_vtx[len++] = quad[0];
+		path_vtx[len++] = quad[2];
+		path_vtx[len++] = quad[3];
+	}
+
+	if ( len > 0 ) {
+                unbatched_draw();
+		al_draw_prim( path_vtx, NULL, NULL, 0, len,
+			      ALLEGRO_PRIM_TRIANGLE_LIST );
 	}
 }
 
@@ -208,6 +805,9 @@ static void draw_object( struct Object * o )
         case 3:
 		col = al_map_rgb_f(0,1,0);
 		break;
+	case OBJ_TARGET:
+		col = al_map_rgb_f(1,0,1);
+		break;
 	case 4:
 		col = al_map_rgb_f(0,0.5,0.3);
 	default:
@@ -216,172 +816,280 @@ static void draw_object( struct Object * o )
 	}
 
 	/* draws rectange with given colour */
+	unbatched_draw();
 	al_draw_filled_rectangle( (o->pos.x), (o->pos.y - o->dims.y),
 				  (o->pos.x + o->dims.x), (o->pos.y), col );
 	
 }
 
-static void draw_grid() {
-	for (int r=0;r<15;r++) {
-                al_draw_line( 0, r*32, 640, r*32, al_map_rgb_f(1,1,1), 2);
+static void draw_grid( struct Level * l ) {
+	for (int r=0;r<l->height/32;r++) {
+		unbatched_draw();
+                al_draw_line( 0, r*32, l->width, r*32, al_map_rgb_f(1,1,1),
+			      2);
 	}
 
-	for (int c=0;c<20;c++) {
-                al_draw_line( c*32, 0, c*32, 480, al_map_rgb_f(1,1,1), 2);
+	for (int c=0;c<l->width/32;c++) {
+		unbatched_draw();
+                al_draw_line( c*32, 0, c*32, l->height, al_map_rgb_f(1,1,1),
+			      2);
 	}
 }
 
 /*
 void draw_water()
 ---
-Draws a semi-transparent water effect on the bottom of the screen.
+Draws a semi-transparent water effect along the bottom of the level, only
+where it is in view.
 ---
 ALLEGRO_BITMAP * water: bitmap to use
 int frame: what frame the animation is on (assumes FPS is 60)
+struct Level * l: level to draw in
+struct Camera * cam: part of the level in view
 */
-static void draw_water( ALLEGRO_BITMAP * water, int frame )
+static void draw_water( ALLEGRO_BITMAP * water, int frame, struct Level * l,
+			struct Camera * cam )
 {
 	float startx = -64;
-	float starty = 480-32;
+	float starty = l->height-32;
 	float frame_off = 64 * frame/60.0;
+	int first = ( cam->x - startx - frame_off ) / 63 - 1;
+	int last = ( cam->x + VIEW_W - startx - frame_off ) / 63 + 1;
+	int n = ( l->width + 64 ) / 63 + 1;
+
+	if ( first < 0 )
+		first = 0;
+	if ( last > n )
+		last = n;
 	
-	for (int i = 0; i < 12; i++) {
-                al_draw_tinted_bitmap( water, al_map_rgba_f(1,1,1,0.5),
-				       (startx + frame_off + i*63 ), starty,
-				       100);
+	for (int i = first; i < last; i++) {
+                batch_bitmap( water, al_map_rgba_f(1,1,1,0.5),
+			      (startx + frame_off + i*63 ), starty );
 	}
 }
 
 
-static void draw_projectile( ALLEGRO_BITMAP * proj, struct Projectile * p,
-			     struct Level * l ) {
-	float step_x, step_y;
-	unsigned int type = 0;
-	if ( !(p->p_coll > 0) ) {
-                p->active = 0;
-	} else {
-		//calculate new position and increment time
-		calculate_position( &p->vel, &p->pos, &p->s_pos, l, p->time );
-		//calculate how far the throw is allowed to go
-		p->p_coll = do_step_collision( &p->pos, &p->p_pos, l, &type );
-
-		step_x = ( p->pos.x - p->p_pos.x ) / 4;
-		step_y = ( p->pos.y - p->p_pos.y ) / 4;
-
-		//fix position of throw to stop it from being inside a wall
-		p->pos.x = p->p_pos.x + step_x * p->p_coll;
-		p->pos.y = p->p_pos.y + step_y * p->p_coll;
-
-		//check type of collision
-		switch (type) {
-		case 1:
-			//rebound
-			do_rebound( p );
-			break;
-		case 2:
-			//jump pad
-			do_bounce( p, -250 );
-			break;
-                case 3:
-			//jump pad but smaller
-                        do_bounce( p, -100 );
-			break;
-                case 4:
-			//jump pad mid
-                        do_bounce( p, -200 );
-			break;
-		default:
-			p->time = p->time + TIME_INC;
-			break;
-		}
-		float y_comp = (p->pos.y - p->p_pos.y);
-		float x_comp = (p->pos.x - p->p_pos.x);
-                float angle = atan(y_comp/x_comp);
-
-		if (x_comp < 0)
-		        al_draw_scaled_rotated_bitmap(proj, 9, 6, p->pos.x, p->pos.y, 2, 2, angle, ALLEGRO_FLIP_HORIZONTAL);
-		else
-			al_draw_scaled_rotated_bitmap(proj, 9, 6, p->pos.x, p->pos.y, 2, 2, angle, 0);
+/*
+void draw_projectile()
+---
+Draws a single projectile where the last simulate_step() left it, pointing in
+the direction it moved
+---
+ALLEGRO_BITMAP * proj: bitmap of arrow to draw
+struct Proj_arr * p: projectile array to use
+unsigned int i: index of the projectile to draw
+*/
+static void draw_projectile( ALLEGRO_BITMAP * proj, struct Proj_arr * p,
+			     unsigned int i ) {
+	float y_comp = (p->y[i] - p->py[i]);
+	float x_comp = (p->x[i] - p->px[i]);
+	float angle = atan(y_comp/x_comp);
 
-		p->p_pos.x = p->pos.x;
-		p->p_pos.y = p->pos.y;
-	}
+	int flags = 0;
+	if (x_comp < 0)
+	        flags = ALLEGRO_FLIP_HORIZONTAL;
+	batch_sprite(proj, 0, 0, al_get_bitmap_width(proj),
+		     al_get_bitmap_height(proj), al_map_rgb_f(1, 1, 1),
+		     9, 6, p->x[i], p->y[i], 2, 2, angle, flags);
 }
 
 /*
 void draw_projectiles()
 ---
-Draws all active projectiles in Proj_arr (i.e. any currently in flight)
+Draws all projectiles in Proj_arr (i.e. any currently in flight). Does not
+move them, see simulate_step().
 ---
 struct Proj_arr * proj_arr: projectile array to draw
 ALLEGRO_BITMAP * proj: bitmap of arrow to draw
-struct Level * l: level to use
 */
 static void draw_projectiles( struct Proj_arr * proj_arr,
-			      ALLEGRO_BITMAP * proj,
-			      struct Level * l )
+			      ALLEGRO_BITMAP * proj )
+{
+        for (unsigned int p = 0; p < proj_arr->count; p++)
+		draw_projectile(proj, proj_arr, p);
+}
+
+/* bitmaps loaded so far, shared between every struct Bitmap */
+static struct Asset assets[ASSET_CACHE_SZ];
+static struct Cache_stats cache_stats;
+
+/*
+static struct Asset * find_asset()
+---
+Finds the cache entry holding a given bitmap
+---
+ALLEGRO_BITMAP * bmp: bitmap to look for
+---
+Returns the entry, NULL if the bitmap is not in the cache
+*/
+static struct Asset * find_asset( ALLEGRO_BITMAP * bmp )
 {
-        for (int p = 0; p < proj_arr->size; p++) {
-		if( proj_arr->arr[p].active ){
-			draw_projectile(proj, &proj_arr->arr[p], l);
+        for ( int i = 0; i < ASSET_CACHE_SZ; i++ ) {
+                if ( assets[i].refs > 0 && assets[i].bmp == bmp )
+			return &assets[i];
+	}
+	return NULL;
+}
+
+/*
+static ALLEGRO_BITMAP * acquire_bitmap()
+---
+Gets a bitmap from the asset cache, only loading it from disk if no one else
+holds it already.
+---
+char * path: file to load the bitmap from
+---
+Returns the bitmap, NULL on fail
+*/
+static ALLEGRO_BITMAP * acquire_bitmap( char * path )
+{
+	struct Asset * free_slot = NULL;
+	
+        for ( int i = 0; i < ASSET_CACHE_SZ; i++ ) {
+                if ( assets[i].refs > 0 &&
+		     strcmp( assets[i].path, path ) == 0 ) {
+			/* already loaded */
+			assets[i].refs++;
+			cache_stats.hits++;
+			return assets[i].bmp;
 		}
+		if ( assets[i].refs == 0 && free_slot == NULL )
+			free_slot = &assets[i];
+	}
+
+	if ( free_slot == NULL ) {
+                fprintf( stderr, "Asset cache is full!\n" );
+		return NULL;
+	}
+
+	/* not loaded yet, so load from disk */
+	double start = al_get_time();
+	ALLEGRO_BITMAP * bmp = al_load_bitmap( path );
+	cache_stats.load_time += al_get_time() - start;
+	cache_stats.misses++;
+
+	if ( bmp == NULL ) {
+                fprintf( stderr, "Could not load %s!\n", path );
+		return NULL;
+	}
+	
+	snprintf( free_slot->path, sizeof( free_slot->path ), "%s", path );
+	free_slot->bmp = bmp;
+	free_slot->refs = 1;
+	free_slot->masked = 0;
+
+	return bmp;
+}
+
+/*
+static void release_bitmap()
+---
+Gives up a hold on a bitmap from the asset cache. The bitmap is destroyed once
+nothing holds it anymore.
+---
+ALLEGRO_BITMAP * bmp: bitmap to release
+*/
+static void release_bitmap( ALLEGRO_BITMAP * bmp )
+{
+	struct Asset * a = find_asset( bmp );
+	if ( a == NULL )
+		return;
+
+	a->refs--;
+	if ( a->refs == 0 ) {
+                al_destroy_bitmap( a->bmp );
+		a->bmp = NULL;
 	}
 }
 
+/*
+static void mask_bitmap()
+---
+Masks a cached bitmap, unless it has already been masked
+---
+ALLEGRO_BITMAP * bmp: bitmap to mask
+*/
+static void mask_bitmap( ALLEGRO_BITMAP * bmp )
+{
+	struct Asset * a = find_asset( bmp );
+	if ( a == NULL || a->masked )
+		return;
+	
+	double start = al_get_time();
+        al_convert_mask_to_alpha( bmp, al_map_rgb_f(1,0,1) );
+	cache_stats.load_time += al_get_time() - start;
+	a->masked = 1;
+}
+
 /*
 void load_bitmaps()
 ---
-This function loads all the bitmap objects into struct Bitmap
+This function loads all the bitmap objects into struct Bitmap. Bitmaps already
+held by another struct Bitmap are shared instead of being loaded again.
 ---
 struct Bitmap * b: struct to load into
 */
 void load_bitmaps( struct Bitmap * b )
 {
-	b->ts = al_load_bitmap("tilesets/all.bmp");
-	b->plyr = al_load_bitmap("tilesets/player.bmp");
-	b->plyr_bow = al_load_bitmap("tilesets/bow.bmp");
-	b->proj = al_load_bitmap("tilesets/proj.bmp");
-	b->water = al_load_bitmap("tilesets/water.bmp");
-	b->font = al_load_bitmap("tilesets/font.bmp");
-	b->bg = al_load_bitmap("tilesets/menu_bg.bmp");
-	b->target = al_load_bitmap("tilesets/target.bmp");
+	b->ts = acquire_bitmap("tilesets/all.bmp");
+	b->plyr = acquire_bitmap("tilesets/player.bmp");
+	b->plyr_bow = acquire_bitmap("tilesets/bow.bmp");
+	b->proj = acquire_bitmap("tilesets/proj.bmp");
+	b->water = acquire_bitmap("tilesets/water.bmp");
+	b->font = acquire_bitmap("tilesets/font.bmp");
+	b->bg = acquire_bitmap("tilesets/menu_bg.bmp");
+	b->target = acquire_bitmap("tilesets/target.bmp");
 }
 
 /*
 void free_bitmaps()
 ---
-This function frees all the bitmap objects into struct Bitmap
+This function releases all the bitmap objects in struct Bitmap. Each is only
+destroyed once no other struct Bitmap holds it.
 ---
 struct Bitmap * b: struct to free
 */
 void free_bitmaps( struct Bitmap * b )
 {
-        al_destroy_bitmap(b->ts);
-	al_destroy_bitmap(b->plyr);
-	al_destroy_bitmap(b->plyr_bow);
-	al_destroy_bitmap(b->proj);
-	al_destroy_bitmap(b->water);
-	al_destroy_bitmap(b->font);
-	al_destroy_bitmap(b->bg);
-	al_destroy_bitmap(b->target);
+        release_bitmap(b->ts);
+	release_bitmap(b->plyr);
+	release_bitmap(b->plyr_bow);
+	release_bitmap(b->proj);
+	release_bitmap(b->water);
+	release_bitmap(b->font);
+	release_bitmap(b->bg);
+	release_bitmap(b->target);
 }
 
 /*
 void mask_bitmaps()
 ---
-Masks the bitmaps in struct bitmap to allow transparent bitmaps.
+Masks the bitmaps in struct bitmap to allow transparent bitmaps. Bitmaps that
+were already masked are skipped.
 ---
 struct Bitmap * b: bitmaps to mask
 */
 void mask_bitmaps( struct Bitmap * b)
 {
-        al_convert_mask_to_alpha( b->ts, al_map_rgb_f(1,0,1) );
-        al_convert_mask_to_alpha( b->plyr, al_map_rgb_f(1,0,1) );
-        al_convert_mask_to_alpha( b->plyr_bow, al_map_rgb_f(1,0,1) );
-        al_convert_mask_to_alpha( b->proj, al_map_rgb_f(1,0,1) );
-	al_convert_mask_to_alpha( b->water, al_map_rgb_f(1,0,1) );
-	al_convert_mask_to_alpha( b->font, al_map_rgb_f(1,0,1) );
-	al_convert_mask_to_alpha( b->target, al_map_rgb_f(1,0,1) );
+        mask_bitmap( b->ts );
+        mask_bitmap( b->plyr );
+        mask_bitmap( b->plyr_bow );
+        mask_bitmap( b->proj );
+	mask_bitmap( b->water );
+	mask_bitmap( b->font );
+	mask_bitmap( b->target );
+}
+
+/*
+void get_cache_stats()
+---
+Gets the hit/miss counts and load time of the asset cache
+---
+struct Cache_stats * cs: struct to copy the stats into
+*/
+void get_cache_stats( struct Cache_stats * cs )
+{
+        *cs = cache_stats;
 }
 
 /*
@@ -403,7 +1111,7 @@ static void draw_char( char ch, int x, int y, ALLEGRO_BITMAP * font )
 {
 	int ty = 0;
 	int tx = (ch - 32) * 8; //32 is start of visible chars in ASCII
-        al_draw_scaled_bitmap( font, tx, ty, 8, 8, x, y, 16, 16, 0);
+        batch_scaled( font, tx, ty, 8, 8, x, y, 16, 16, 0);
 }
 
 /*
@@ -451,65 +1159,136 @@ static void draw_stats( struct Level * l, unsigned int score,
 	char buf_b[32];
 	size = snprintf( buf_b, 32, "$%i", score );
 	draw_text( buf_b, size, (640 - 16*size), 0, font );
+
+	/* if debug, show how many draw calls the last frame took */
+	#if DEBUG
+	char buf_c[32];
+	size = snprintf( buf_c, 32, "Draws: %u", get_draw_calls() );
+	draw_text( buf_c, size, 0, 16, font );
+	#endif
 }
 
+#if FRAME_TIMING
+/*
+void draw_timing_hud()
+---
+Draws the average time of each phase of draw_screen() over the last
+HUD_FRAMES frames, and their total
+---
+ALLEGRO_BITMAP * font: font tileset to use
+*/
+static void draw_timing_hud( ALLEGRO_BITMAP * font )
+{
+        double avg[N_PHASES] = { 0 };
+	double total = 0;
+	unsigned int n = timed_frames < HUD_FRAMES ? timed_frames : HUD_FRAMES;
+	char buf[32];
+	int size;
+
+	if ( n == 0 )
+		return;
+	for ( unsigned int f = 1; f <= n; f++ ) {
+                unsigned int row = ( timing_slot + TIMING_FRAMES - f ) %
+			TIMING_FRAMES;
+		for ( int p = 0; p < N_PHASES; p++ )
+			avg[p] += phase_ms[row][p] / n;
+	}
+	for ( int p = 0; p < N_PHASES; p++ ) {
+                size = snprintf( buf, 32, "%-7s%6.2f", phase_names[p],
+				 avg[p] );
+		draw_text( buf, size, 0, 32 + 16 * p, font );
+		total += avg[p];
+	}
+	size = snprintf( buf, 32, "%-7s%6.2f", "ms", total );
+	draw_text( buf, size, 0, 32 + 16 * N_PHASES, font );
+}
+#endif
+
 /*
 void draw_screen()
 ---
-This function handles drawing everything on the screen.
+This function handles drawing everything on the screen. Only reads the level
+and projectiles, they are moved on by simulate_step(). The level is drawn
+from the camera's point of view, with only the parts in view drawn.
 ---
 struct Level * l: level to draw
-ALLEGRO_BITMAP * fg: foreground tileset (stored as bitmap)
-ALLEGRO_BITMAP * bg: background tileset (stored as bitmap)
+struct Position * mouse: current mouse position in the level
+struct Proj_arr * proj_arr: projectiles to draw
+struct Bitmap * b: holds all bitmap objects for the game
+struct Layers * ly: baked chunks of the level's tilemaps
+struct Camera * cam: part of the level in view
+int frame: what frame the animation is on
+unsigned int score: current score
 ---
 Returns nothing
 */
 void draw_screen( struct Level * l, struct Position * mouse,
 		  struct Proj_arr * proj_arr, struct Bitmap * b,
-		  int frame, unsigned int score )
+		  struct Layers * ly, struct Camera * cam, int frame,
+		  unsigned int score )
 {
-	/* if alt tilemap */
-	int offset = 0;
-	if ( l->level > 7 )
-		offset = 3;
+	ALLEGRO_TRANSFORM t;
 	
+        START_PHASES();
+	ly->clock++;
+
         /* clear screen */
         al_clear_to_color( al_map_rgb_f( 0, 0, 0 ) );
 
+	/* everything up to the stats is drawn where it is in the level,
+	   snapped to whole px so tiles don't shimmer */
+	al_identity_transform( &t );
+	al_translate_transform( &t, -floorf( cam->x ), -floorf( cam->y ) );
+	al_use_transform( &t );
+
 	/* background tilemap */
-	draw_tilemap( l->bg.map, l->bg.rows, l->bg.cols,
-		      b->ts, ( 0 + offset) );
+	draw_layer( ly, l, b->ts, cam, 0 );
+	END_PHASE( PHASE_BG );
 	
 	draw_target( b->target, l->target_pos.x, l->target_pos.y );
+	END_PHASE( PHASE_TARGET );
 	draw_character(b->plyr, b->plyr_bow, mouse, l );
+	END_PHASE( PHASE_CHAR );
 
 	/* if alt tilemap */
         if ( l->level > 7 )
-		draw_water( b->water, frame);
+		draw_water( b->water, frame, l, cam );
+	END_PHASE( PHASE_WATER );
 
 	draw_projectile_path(mouse, l);
-	draw_projectiles( proj_arr, b->proj, l );
+	END_PHASE( PHASE_PATH );
+	draw_projectiles( proj_arr, b->proj );
+	END_PHASE( PHASE_PROJ );
 
 
-	/* foreground tileset */
-	draw_tilemap( l->fg.map, l->fg.rows, l->fg.cols,
-		      b->ts, ( 1 + offset ) );
-
-	/* draw overlayed decorations tilemap */
-	draw_tilemap( l->dec.map, l->dec.rows, l->dec.cols,
-		      b->ts, ( 2 + offset) );
+	/* foreground tileset with overlayed decorations tilemap, both in
+	   the baked front layer */
+	draw_layer( ly, l, b->ts, cam, 1 );
+	END_PHASE( PHASE_FG );
 
 	/* if debug, draw each object's collider and its type, along with
            a tile grid */
 	#if DEBUG
 	for (int i = 0;i<l->index;i++)
                 draw_object(&l->object_arr[i]);
-        draw_grid();
+        draw_grid( l );
 	#endif
 
+	/* stats stay put on the screen */
+	flush_batch();
+	al_identity_transform( &t );
+	al_use_transform( &t );
+
 	draw_stats( l, score, b->font );
+	#if FRAME_TIMING
+	if ( timing_hud )
+		draw_timing_hud( b->font );
+	#endif
+	END_PHASE( PHASE_STATS );
 	
-	al_flip_display();
+	end_frame();
+	END_PHASE( PHASE_FLIP );
+	END_TIMED_FRAME();
 }
 
 /*
@@ -525,11 +1304,11 @@ void draw_menu( struct Bitmap * b )
 	al_clear_to_color( al_map_rgb_f( 0,0,0 ) );
 
 	/* draw menu's bg */
-	al_draw_scaled_bitmap( b->bg, 0, 0, 160, 120, 0, 0, 640, 480, 0 );
+	batch_scaled( b->bg, 0, 0, 160, 120, 0, 0, 640, 480, 0 );
 
 	/* draw text onto screen */
 	draw_text( "Press enter to start", 20, 160, 208, b->font );
-	al_flip_display();
+	end_frame();
 }
 
 /*
@@ -546,14 +1325,14 @@ void draw_end_menu( struct Bitmap * b, unsigned int score )
 	al_clear_to_color( al_map_rgb_f( 0,0,0 ) );
 
 	/* draw menu's bg */
-	al_draw_scaled_bitmap( b->bg, 0, 0, 160, 120, 0, 0, 640, 480, 0 );
+	batch_scaled( b->bg, 0, 0, 160, 120, 0, 0, 640, 480, 0 );
 
 	/* draw text onto screen */
 	char buf[32];
 	int size = snprintf(buf, 32, "Score: $%i", score);
 	draw_text( buf, size, (240 - 8 * size ), 208, b->font );
 	draw_text( "Congratulations! You won!", 25, 128, 192, b->font );
-	al_flip_display();
+	end_frame();
 }
 
 
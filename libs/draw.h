@@ -16,11 +16,106 @@ drawing on the screen or to do with allegro
 
 #include "structures.h"
 #include "physics.h"
+#include "game.h"
+
+#define ASSET_CACHE_SZ (16)
+#define CHUNK_TILES (16) /* tiles across and down in a baked chunk */
+#define CHUNK_CACHE_SZ (12) /* no. of baked chunks kept, at most 6 are in view
+			       at once */
+
+/**
+struct Bitmap
+---
+Bitmap struct used to store all images needed for the game.
+*/
+struct Bitmap {
+        ALLEGRO_BITMAP * ts;         //combined tileset for all levels
+	ALLEGRO_BITMAP * plyr;       //player
+	ALLEGRO_BITMAP * plyr_bow;   //bow
+	ALLEGRO_BITMAP * proj;       //arrow
+	ALLEGRO_BITMAP * water;      //water texture
+	ALLEGRO_BITMAP * font;       //font tileset
+	ALLEGRO_BITMAP * bg;         //start menu's bg
+	ALLEGRO_BITMAP * target;     //target bmp
+};
+
+/**
+struct Asset
+---
+Asset struct used to store a bitmap loaded by the asset cache, so each image
+is only decoded and masked once no matter how many times it is requested.
+---
+char path[64]: file the bitmap was loaded from
+ALLEGRO_BITMAP * bmp: loaded bitmap
+unsigned int refs: no. of holders of the bitmap, freed when it reaches 0
+unsigned int masked: whether the bitmap has been masked yet
+*/
+struct Asset {
+        char path[64];
+	ALLEGRO_BITMAP * bmp;
+	unsigned int refs;
+	unsigned int masked;
+};
+
+/**
+struct Cache_stats
+---
+Cache_stats struct used to report how well the asset cache is doing
+---
+unsigned int hits: no. of requests served from the cache
+unsigned int misses: no. of requests that had to load from disk
+double load_time: total time spent loading and masking bitmaps (in seconds)
+*/
+struct Cache_stats {
+        unsigned int hits;
+	unsigned int misses;
+	double load_time;
+};
+
+/**
+struct Chunk
+---
+Chunk struct used to store a CHUNK_TILES x CHUNK_TILES block of a level's
+static tilemaps pre-rendered into off-screen bitmaps, so each layer of it
+only costs one blit per frame. Chunks on the right and bottom edges of a level
+may be smaller.
+---
+ALLEGRO_BITMAP * back: bg tiles, drawn behind everything else
+ALLEGRO_BITMAP * front: fg and dec tiles composed together, drawn over the
+                        player and projectiles
+int cx, cy: which chunk across and down it is, -1 if the slot is unused
+unsigned int last_used: when the chunk was last drawn (see struct Layers)
+*/
+struct Chunk {
+        ALLEGRO_BITMAP * back;
+	ALLEGRO_BITMAP * front;
+	int cx;
+	int cy;
+	unsigned int last_used;
+};
+
+/**
+struct Layers
+---
+Layers struct used to keep the baked chunks of a level that were drawn most
+recently. Chunks are baked when they first come into view, and the least
+recently drawn is replaced when there is no room, so only the chunks around
+the view are ever kept no matter how big the level is.
+---
+struct Chunk chunks[]: baked chunks
+unsigned int clock: incremented each frame, used to find the least recently
+                    drawn chunk
+*/
+struct Layers {
+        struct Chunk chunks[CHUNK_CACHE_SZ];
+	unsigned int clock;
+};
 
 /*
 void load_bitmaps()
 ---
-This function loads al the bitmap objects into struct Bitmap
+This function loads al the bitmap objects into struct Bitmap. Bitmaps are
+shared through a refcounted cache, so each is only loaded from disk once.
 ---
 struct Bitmap * b: struct to load into
 */
@@ -29,7 +124,8 @@ void load_bitmaps( struct Bitmap * );
 /*
 void free_bitmaps()
 ---
-This function frees all the bitmap objects into struct Bitmap
+This function releases all the bitmap objects in struct Bitmap. Each is only
+destroyed once nothing else holds it.
 ---
 struct Bitmap * b: struct to free
 */
@@ -38,7 +134,8 @@ void free_bitmaps( struct Bitmap * );
 /*
 void mask_bitmaps()
 ---
-This function masks all the bitmaps in struct Bitmap
+This function masks all the bitmaps in struct Bitmap, skipping any that were
+already masked
 ---
 struct Bitmap *: bitmaps to mask
 ---
@@ -46,20 +143,99 @@ Returns nothing
 */
 void mask_bitmaps(struct Bitmap *);
 
+/*
+void get_cache_stats()
+---
+Gets the hit/miss counts and load time of the asset cache
+---
+struct Cache_stats * cs: struct to copy the stats into
+*/
+void get_cache_stats( struct Cache_stats * );
+
+/*
+void initialize_layers()
+---
+Initializes a given struct Layers with no chunks baked
+---
+struct Layers * ly: struct to initialize
+*/
+void initialize_layers( struct Layers * );
+
+/*
+void free_layers()
+---
+Frees the baked chunks in struct Layers, leaving it empty. Must be called when
+the level or its tilemaps change, so the chunks are baked again.
+---
+struct Layers * ly: struct to free
+*/
+void free_layers( struct Layers * );
+
+/*
+void toggle_timing_hud()
+---
+Shows or hides the frame timing overlay. Does nothing unless built with
+FRAME_TIMING.
+---
+Returns nothing
+*/
+void toggle_timing_hud();
+
+/*
+unsigned int is_animated()
+---
+Checks if the game screen changes from frame to frame on its own, with nothing
+in the level moving. The water of the alt tilemap levels flows, and the frame
+timing overlay (if shown) updates every frame.
+---
+struct Level * l: level being played
+---
+Returns an unsigned int, 1 if animated, 0 if not
+*/
+unsigned int is_animated( struct Level * );
+
+/*
+void write_frame_timing()
+---
+Writes any frames timed since frame_timing.csv was last written to it. Does
+nothing unless built with FRAME_TIMING.
+---
+Returns nothing
+*/
+void write_frame_timing();
+
 /*
 void draw_screen()
 ---
-This function handles drawing everything on the screen.
+This function handles drawing everything on the screen. Only reads the level
+and projectiles, they are moved on by simulate_step(). The level is drawn
+from the camera's point of view, with only the parts in view drawn.
 ---
 struct Level * l: level to draw
-
+struct Position * mouse: current mouse position in the level
+struct Proj_arr * proj_arr: projectiles to draw
+struct Bitmap * b: holds all bitmap objects for the game
+struct Layers * ly: baked chunks of the level's tilemaps
+struct Camera * cam: part of the level in view
+int frame: what frame the animation is on
+unsigned int score: current score
 ---
 Returns nothing
 */
 void draw_screen( struct Level *, struct Position *, struct Proj_arr *,
-		  struct Bitmap *, int,
+		  struct Bitmap *, struct Layers *, struct Camera *, int,
 		  unsigned int);
 
+/*
+unsigned int get_draw_calls()
+---
+Gets the no. of draw calls issued to draw the last frame. Sprites are batched
+by texture, so this is much less than the no. of sprites drawn.
+---
+Returns an unsigned int
+*/
+unsigned int get_draw_calls();
+
 /*
 void draw_menu()
 ---
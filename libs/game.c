@@ -0,0 +1,806 @@
+/**
+game.c
+---
+File used to store the game itself: loading levels, firing and stepping
+projectiles, moving the camera and keeping score, one fixed tick at a time.
+Runs on a thread of its own and needs no allegro. The thread drawing the game
+never touches any of it directly; it pushes inputs in through a queue and gets
+snapshots of the game back, neither side ever waiting on a lock. The only lock
+is taken to wake the game's thread when it is sleeping with nothing to play.
+
+Functions that should not be accessed outside of this file are given the
+keyword 'static'.
+*/
+
+#include "game.h"
+#include "level.h"
+#include "physics.h"
+#include "replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+/*
+static void clamp_camera()
+---
+Keeps a camera's view inside the level, or in its top left corner if the
+level is smaller than the view
+---
+struct Camera * cam: camera to clamp
+struct Level * l: level being played
+*/
+static void clamp_camera( struct Camera * cam, struct Level * l )
+{
+        float max_x = l->width - VIEW_W;
+	float max_y = l->height - VIEW_H;
+
+	if ( cam->x > max_x )
+		cam->x = max_x;
+	if ( cam->y > max_y )
+		cam->y = max_y;
+	if ( cam->x < 0 )
+		cam->x = 0;
+	if ( cam->y < 0 )
+		cam->y = 0;
+}
+
+/*
+void reset_camera()
+---
+Moves a camera straight to the player of a level
+---
+struct Camera * cam: camera to move
+struct Level * l: level being played
+*/
+void reset_camera( struct Camera * cam, struct Level * l )
+{
+        cam->x = l->start_pos.x - VIEW_W / 2;
+	cam->y = l->start_pos.y - VIEW_H / 2;
+	clamp_camera( cam, l );
+}
+
+/*
+void update_camera()
+---
+Eases a camera towards the arrow fired last, or back to the player once that
+arrow has stopped, keeping the view inside the level. Called once per tick.
+---
+struct Camera * cam: camera to move
+struct Level * l: level being played
+struct Proj_arr * p: projectiles of the level
+*/
+void update_camera( struct Camera * cam, struct Level * l,
+		    struct Proj_arr * p )
+{
+        struct Position target = l->start_pos;
+	int i = get_projectile( p, p->newest );
+
+	if ( i >= 0 )
+		initialize_position( &target, p->x[i], p->y[i] );
+
+	cam->x += ( target.x - VIEW_W / 2 - cam->x ) * CAMERA_EASE;
+	cam->y += ( target.y - VIEW_H / 2 - cam->y ) * CAMERA_EASE;
+	clamp_camera( cam, l );
+}
+
+/*
+static unsigned int calculate_score()
+---
+Calculates a score for the level just completed based on the number of arrows
+fired.
+---
+int arrows_fired: no. of arrows fired
+---
+Returns an  unsigned int representing the score calculated.
+*/
+static unsigned int calculate_score( int arrows_fired )
+{
+	if ( arrows_fired == 1 )
+		return MAX_SCORE;
+	else if ( arrows_fired < 5 )
+		return MAX_SCORE / 2;
+	else
+		return MAX_SCORE / 5;
+}
+
+/*
+static unsigned int check_for_win_cond()
+---
+Checks the trigger events of the last simulate_step() for a projectile
+entering the target. The events come from the collision checks, so no
+projectile is looked at again.
+---
+struct Proj_arr * p_arr: struct to use
+---
+Returns an unsigned int, 1 on win, 0 on no win
+*/
+static unsigned int check_for_win_cond( struct Proj_arr * p_arr )
+{
+        for ( unsigned int i = 0; i < p_arr->n_events; i++ ) {
+                if ( p_arr->events[i].type == OBJ_TARGET )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+static unsigned int level_in_use()
+---
+Checks if a level is being played, or may be being drawn. The drawing thread
+only ever holds the front or middle snapshot, which can be any but back
+---
+struct Game * g: game to use
+struct Level * l: level to check
+---
+Returns an unsigned int, 1 if in use, 0 if not
+*/
+static unsigned int level_in_use( struct Game * g, struct Level * l )
+{
+        if ( l == g->l )
+		return 1;
+	for ( unsigned int i = 0; i < SNAPSHOTS; i++ ) {
+                if ( i != g->back && g->snaps[i].level == l )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+static struct Level * get_free_level()
+---
+Gets a level slot that holds nothing, first freeing any level that is no
+longer in use
+---
+struct Game * g: game to use
+---
+Returns a struct Level *, NULL if every slot is still in use (which can't
+happen with GAME_LEVELS slots)
+*/
+static struct Level * get_free_level( struct Game * g )
+{
+	for ( int i = 0; i < GAME_LEVELS; i++ ) {
+                if ( g->used[i] && !level_in_use( g, &g->levels[i] ) ) {
+                        free_level( &g->levels[i] );
+			g->used[i] = 0;
+		}
+		if ( !g->used[i] )
+			return &g->levels[i];
+	}
+	return NULL;
+}
+
+/*
+static void retire_level()
+---
+Hands back the level being played. It is freed once no longer in use, see
+get_free_level()
+---
+struct Game * g: game to use
+*/
+static void retire_level( struct Game * g )
+{
+	g->l = NULL;
+}
+
+/*
+static void load_current_level()
+---
+Swaps in curr_level from the loader and has it start on the one after
+---
+struct Game * g: game to use
+*/
+static void load_current_level( struct Game * g )
+{
+        struct Level * l = get_free_level( g );
+	if ( l == NULL )
+		return;
+
+	retire_level( g );
+	take_level( &g->loader, l, g->curr_level );
+	g->used[l - g->levels] = 1;
+	g->l = l;
+	if ( g->curr_level < LAST_LEVEL )
+		prefetch_level( &g->loader, g->curr_level + 1 );
+
+	/* start the view on the player */
+	reset_camera( &g->camera, l );
+	watch_level( &g->watch, l->level );
+	reset_proj_arr( &g->proj );
+
+	g->do_load = 0;
+	g->reload = 0;
+	g->arrows_fired = 0;
+	g->loaded = 1;
+	g->version++;
+}
+
+/*
+static void reload_current_level()
+---
+Reloads the files of the level being played that changed on disk, building
+the reloaded level in a free slot (see reload_level()) and swapping it in,
+leaving projectiles where they are. The old level can't be changed in place
+as it may be being drawn
+---
+struct Game * g: game to use
+*/
+static void reload_current_level( struct Game * g )
+{
+        struct Level * l = get_free_level( g );
+	if ( l == NULL )
+		return;
+
+	reload_level( l, g->l, g->reload );
+	g->used[l - g->levels] = 1;
+	retire_level( g );
+	g->l = l;
+
+	g->reload = 0;
+	g->version++;
+}
+
+/*
+static float to_float()
+---
+Gets the float stored in a record value, bit for bit
+---
+unsigned int v: value to use
+---
+Returns a float
+*/
+static float to_float( unsigned int v )
+{
+        float f;
+	memcpy( &f, &v, sizeof( f ) );
+	return f;
+}
+
+/*
+static unsigned int from_float()
+---
+Gets a float as a record value, bit for bit
+---
+float f: float to use
+---
+Returns an unsigned int
+*/
+static unsigned int from_float( float f )
+{
+        unsigned int v;
+	memcpy( &v, &f, sizeof( v ) );
+	return v;
+}
+
+/*
+static void apply_input()
+---
+Uses an input, recording it if the game is being recorded. Focus only changes
+how often the game ticks, not how it plays, so it is never recorded
+---
+struct Game * g: game to use
+struct Input * in: input to use
+*/
+static void apply_input( struct Game * g, struct Input * in )
+{
+        if ( g->rec != NULL && in->type != INPUT_FOCUS )
+		record( g->rec, g->ticks, in->type, from_float( in->x ),
+			from_float( in->y ) );
+
+	switch ( in->type ) {
+	case INPUT_MOUSE:
+		initialize_position( &g->win_mouse, in->x, in->y );
+		break;
+	case INPUT_FIRE:
+		if ( g->screen == SCREEN_GAME )
+			g->create_proj = 1;
+		break;
+	case INPUT_START:
+		if ( g->screen == SCREEN_MENU ) {
+                        g->screen = SCREEN_GAME;
+			g->version++;
+		}
+		break;
+	case INPUT_FOCUS:
+		g->focused = in->x != 0;
+		break;
+	}
+}
+
+/*
+static void take_inputs()
+---
+Uses up every input pushed to a game so far, in the order they were pushed.
+While a replay is played, only its inputs are used, apart from focus
+---
+struct Game * g: game to use
+*/
+static void take_inputs( struct Game * g )
+{
+        unsigned int tail = atomic_load_explicit( &g->input.tail,
+						  memory_order_relaxed );
+	unsigned int head = atomic_load_explicit( &g->input.head,
+						  memory_order_acquire );
+
+	for ( ; tail != head; tail++ ) {
+                struct Input * in = &g->input.items[tail %
+						    INPUT_QUEUE_SZ];
+		if ( g->play == NULL || in->type == INPUT_FOCUS )
+			apply_input( g, in );
+	}
+	atomic_store_explicit( &g->input.tail, tail, memory_order_release );
+}
+
+/*
+static unsigned int play_records()
+---
+Plays back the records of the replay being played for this tick, in order,
+up to the first of a type the tick hasn't got to yet
+---
+struct Game * g: game to use
+unsigned int last: highest record type to play (INPUT_* < REC_RELOAD <
+		   REC_LEVEL, REC_CHECK and REC_END)
+---
+Returns an unsigned int, CHANGED_* flags of any reloads played
+*/
+static unsigned int play_records( struct Game * g, unsigned int last )
+{
+        struct Replay * r = g->play;
+	unsigned int changed = 0;
+
+	while ( r->next < r->count && r->recs[r->next].tick == g->ticks &&
+		r->recs[r->next].type <= last ) {
+                struct Replay_rec * rec = &r->recs[r->next++];
+		if ( rec->type == REC_RELOAD ) {
+                        changed |= rec->a;
+		} else if ( rec->type >= REC_LEVEL ) {
+                        r->checks++;
+			if ( rec->a != hash_game( g ) && r->desyncs++ == 0 )
+				r->first_desync = g->ticks;
+		} else {
+                        struct Input in = { rec->type, to_float( rec->a ),
+					    to_float( rec->b ) };
+			apply_input( g, &in );
+		}
+	}
+	return changed;
+}
+
+/*
+static void check_tick()
+---
+Ends a tick of a game being recorded or played back. Records a check of the
+game's state on each level loaded and every REPLAY_CHECK_TICKS ticks of play,
+or checks the game against the replay's checks. Any record of the replay left
+over from this tick or before means the game didn't play out the same
+---
+struct Game * g: game to use
+*/
+static void check_tick( struct Game * g )
+{
+        if ( g->rec != NULL && ( g->loaded ||
+				 ( g->screen == SCREEN_GAME &&
+				   g->ticks % REPLAY_CHECK_TICKS == 0 ) ) )
+		record( g->rec, g->ticks, g->loaded ? REC_LEVEL : REC_CHECK,
+			hash_game( g ), g->curr_level );
+
+	if ( g->play == NULL )
+		return;
+
+	struct Replay * r = g->play;
+	play_records( g, REC_END );
+	for ( ; r->next < r->count && r->recs[r->next].tick <= g->ticks;
+	      r->next++ ) {
+                if ( r->desyncs++ == 0 )
+			r->first_desync = g->ticks;
+	}
+
+	/* carry on with pushed inputs once the replay is over */
+	if ( r->next >= r->count )
+		g->play = NULL;
+}
+
+/*
+unsigned int initialize_game()
+---
+Initializes a game on the start menu. The level to start on is loaded on its
+first tick; nothing runs until game_tick() is called, or the game's thread is
+started
+---
+struct Game * g: game to initialize
+unsigned int level: no. of the level to start on
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_game( struct Game * g, unsigned int level )
+{
+        memset( g, 0, sizeof( *g ) );
+
+	/* the thread sleeps on the same clock it ticks on */
+	pthread_condattr_t attr;
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_mutex_init( &g->lock, NULL );
+	pthread_cond_init( &g->wake, &attr );
+	pthread_condattr_destroy( &attr );
+
+	if ( !initialize_proj_arr( &g->proj, PROJ_ARR_SZ ) )
+		return 0;
+	for ( int i = 0; i < SNAPSHOTS; i++ ) {
+                if ( !initialize_proj_arr( &g->snaps[i].proj, PROJ_ARR_SZ ) ) {
+                        free_game( g );
+			return 0;
+		}
+		g->snaps[i].screen = SCREEN_MENU;
+	}
+	g->back = 0;
+	g->front = 1;
+	atomic_init( &g->middle, 2 );
+	atomic_init( &g->quit, 0 );
+	atomic_init( &g->sleeping, 0 );
+	atomic_init( &g->input.head, 0 );
+	atomic_init( &g->input.tail, 0 );
+
+	g->curr_level = level;
+	g->screen = SCREEN_MENU;
+	g->do_load = 1;
+	g->focused = 1;
+
+	/* start loading levels in the background */
+	start_loader( &g->loader );
+	prefetch_level( &g->loader, level );
+
+	/* watch the current level's files, so edits show up straight away */
+	start_watch( &g->watch );
+	return 1;
+}
+
+/*
+void free_game()
+---
+Frees everything held by a game. Its thread must be stopped first
+---
+struct Game * g: game to free
+*/
+void free_game( struct Game * g )
+{
+        for ( int i = 0; i < GAME_LEVELS; i++ ) {
+                if ( g->used[i] )
+			free_level( &g->levels[i] );
+		g->used[i] = 0;
+	}
+	g->l = NULL;
+	for ( int i = 0; i < SNAPSHOTS; i++ )
+		free_proj_arr( &g->snaps[i].proj );
+	free_proj_arr( &g->proj );
+	stop_loader( &g->loader );
+	stop_watch( &g->watch );
+	pthread_mutex_destroy( &g->lock );
+	pthread_cond_destroy( &g->wake );
+}
+
+/*
+unsigned int push_input()
+---
+Passes an input to the game, to be used on its next tick, waking the game's
+thread if it is sleeping. Only one thread may push inputs to a game
+---
+struct Game * g: game to pass the input to
+unsigned int type: INPUT_* type of the input
+float x, y: values of the input (see INPUT_*)
+---
+Returns 1 on success, 0 if the queue is full (the input is dropped)
+*/
+unsigned int push_input( struct Game * g, unsigned int type, float x, float y )
+{
+        unsigned int head = atomic_load_explicit( &g->input.head,
+						  memory_order_relaxed );
+	unsigned int tail = atomic_load_explicit( &g->input.tail,
+						  memory_order_acquire );
+
+	if ( head - tail >= INPUT_QUEUE_SZ )
+		return 0;
+
+	struct Input * in = &g->input.items[head % INPUT_QUEUE_SZ];
+	in->type = type;
+	in->x = x;
+	in->y = y;
+	atomic_store( &g->input.head, head + 1 );
+
+	/* either the game sees the input before it sleeps (see sleep_idle()),
+	   or it is seen to be sleeping here and woken */
+	if ( atomic_load( &g->sleeping ) ) {
+                pthread_mutex_lock( &g->lock );
+		pthread_cond_signal( &g->wake );
+		pthread_mutex_unlock( &g->lock );
+	}
+	return 1;
+}
+
+/*
+static void run_tick()
+---
+Runs the game on by one tick, once the inputs for it are used
+---
+struct Game * g: game to run
+*/
+static void run_tick( struct Game * g )
+{
+	/* check if level needs loading */
+	if ( g->do_load )
+		load_current_level( g );
+
+	if ( g->screen != SCREEN_GAME || g->l == NULL )
+		return;
+
+	struct Position prev = g->mouse;
+	unsigned int changed, in_flight;
+	float view_x = floorf( g->camera.x );
+	float view_y = floorf( g->camera.y );
+
+	/* update proj_arr if new projectile */
+	if ( g->create_proj ) {
+                g->arrows_fired++;
+		g->create_proj = 0;
+
+		/* fired on the same grid as the aim preview (see get_path()),
+		   so it lands where the preview shows */
+		struct Position aim = g->mouse;
+		snap_aim( &aim );
+		add_to_proj_arr( &g->proj, &aim, g->l->start_pos );
+	}
+
+	/* update mouse pos, in the level rather than the window */
+	initialize_position( &g->mouse, g->win_mouse.x + view_x,
+			     g->win_mouse.y + view_y );
+
+	/* reload level files edited on disk, or when the replay did */
+	changed = poll_watch( &g->watch );
+	if ( g->play != NULL )
+		changed = play_records( g, REC_RELOAD );
+	if ( changed && g->rec != NULL )
+		record( g->rec, g->ticks, REC_RELOAD, changed, 0 );
+	g->reload |= changed;
+	if ( g->reload )
+		reload_current_level( g );
+
+	in_flight = g->proj.count;
+	simulate_step( g->l, &g->proj, TIME_INC );
+	update_camera( &g->camera, g->l, &g->proj );
+
+	/* arrows in flight (or that just landed), the aim or the view all change
+	   the screen */
+	if ( in_flight > 0 || g->proj.count > 0 || prev.x != g->mouse.x ||
+	     prev.y != g->mouse.y || floorf( g->camera.x ) != view_x ||
+	     floorf( g->camera.y ) != view_y )
+		g->version++;
+
+	/* check for win condition */
+	if ( check_for_win_cond( &g->proj ) ) {
+                g->score += calculate_score( g->arrows_fired );
+		g->curr_level += 1;
+		g->version++;
+
+		/* check if entire game finished */
+		retire_level( g );
+		if ( g->curr_level > LAST_LEVEL ) {
+			g->screen = SCREEN_END;
+		} else {
+			g->do_load = 1;
+			load_current_level( g );
+		}
+	}
+}
+
+/*
+void game_tick()
+---
+Runs the game on by one fixed tick: uses every input pushed since the last
+tick (or the inputs of the replay being played), loads or reloads levels,
+fires arrows, steps the projectiles and moves the camera, then checks for a
+win. The game depends on nothing but these inputs and the level files, so the
+same inputs on the same ticks always play out the same. Should only be called
+by one thread
+---
+struct Game * g: game to run
+*/
+void game_tick( struct Game * g )
+{
+        g->ticks++;
+	g->loaded = 0;
+	if ( g->play != NULL )
+		play_records( g, INPUT_FOCUS );
+	take_inputs( g );
+	run_tick( g );
+	if ( g->rec != NULL || g->play != NULL )
+		check_tick( g );
+}
+
+/*
+void publish_snapshot()
+---
+Copies what is needed to draw the game as it is now into a snapshot, and makes
+it the newest one, to be taken by get_snapshot()
+---
+struct Game * g: game to publish
+*/
+void publish_snapshot( struct Game * g )
+{
+        struct Snapshot * s = &g->snaps[g->back];
+
+	/* make room for every projectile, a failed grow just draws fewer */
+	if ( s->proj.size < g->proj.size ) {
+                free_proj_arr( &s->proj );
+		initialize_proj_arr( &s->proj, g->proj.size );
+	}
+	s->proj.count = g->proj.count < s->proj.size ? g->proj.count
+						     : s->proj.size;
+	if ( s->proj.count > 0 ) {
+                size_t sz = s->proj.count * sizeof( float );
+		memcpy( s->proj.x, g->proj.x, sz );
+		memcpy( s->proj.y, g->proj.y, sz );
+		memcpy( s->proj.px, g->proj.px, sz );
+		memcpy( s->proj.py, g->proj.py, sz );
+	}
+
+	s->seq = ++g->seq;
+	s->version = g->version;
+	s->level = g->l;
+	s->mouse = g->mouse;
+	s->camera = g->camera;
+	s->screen = g->screen;
+	s->score = g->score;
+
+	/* the slot given back is either the one last published, or one the
+	   drawing thread has let go of */
+	g->back = atomic_exchange_explicit( &g->middle, g->back | SNAP_FRESH,
+					    memory_order_acq_rel ) & ~SNAP_FRESH;
+}
+
+/*
+struct Snapshot * get_snapshot()
+---
+Gets the newest snapshot of a game for drawing. Until the next call, the game
+leaves it (and the level it points to) alone. Should only be called by the
+drawing thread
+---
+struct Game * g: game to get the snapshot of
+---
+Returns a struct Snapshot *, never NULL
+*/
+struct Snapshot * get_snapshot( struct Game * g )
+{
+        if ( atomic_load_explicit( &g->middle, memory_order_relaxed ) &
+	     SNAP_FRESH )
+		g->front = atomic_exchange_explicit( &g->middle, g->front,
+						     memory_order_acq_rel ) &
+			   ~SNAP_FRESH;
+	return &g->snaps[g->front];
+}
+
+/*
+static void add_ns()
+---
+Moves a time on by a given no. of nanoseconds
+---
+struct timespec * t: time to move on
+long ns: no. of nanoseconds, less than a second
+*/
+static void add_ns( struct timespec * t, long ns )
+{
+        t->tv_nsec += ns;
+	if ( t->tv_nsec >= 1000000000L ) {
+                t->tv_nsec -= 1000000000L;
+		t->tv_sec++;
+	}
+}
+
+/*
+static void sleep_idle()
+---
+Sleeps the game's thread until a given time, or until an input is pushed,
+whichever comes first. While sleeping is set, push_input() takes the lock to
+wake the thread, which it otherwise never does
+---
+struct Game * g: game to sleep
+struct timespec * until: time to wake at (CLOCK_MONOTONIC)
+*/
+static void sleep_idle( struct Game * g, struct timespec * until )
+{
+        pthread_mutex_lock( &g->lock );
+	atomic_store( &g->sleeping, 1 );
+	while ( !atomic_load( &g->quit ) &&
+		atomic_load( &g->input.head ) == atomic_load( &g->input.tail ) )
+		if ( pthread_cond_timedwait( &g->wake, &g->lock, until ) ==
+		     ETIMEDOUT )
+			break;
+	atomic_store( &g->sleeping, 0 );
+	pthread_mutex_unlock( &g->lock );
+}
+
+/*
+static void * run_game()
+---
+Body of the game thread. Ticks FPS times a second, on a fixed schedule so
+ticks don't drift. While there is nothing to play it sleeps for 1/IDLE_FPS
+between ticks instead, or until an input comes in
+---
+void * arg: struct Game * to run
+---
+Returns NULL
+*/
+static void * run_game( void * arg )
+{
+        struct Game * g = arg;
+	struct timespec next, now;
+
+	clock_gettime( CLOCK_MONOTONIC, &next );
+	while ( !atomic_load( &g->quit ) ) {
+                game_tick( g );
+		publish_snapshot( g );
+
+		/* with nothing to play, sleep until the next idle tick or an
+		   input, and start the schedule again from whenever that is */
+		if ( g->screen != SCREEN_GAME || !g->focused ) {
+                        add_ns( &next, 1000000000L / IDLE_FPS );
+			sleep_idle( g, &next );
+			clock_gettime( CLOCK_MONOTONIC, &next );
+			continue;
+		}
+
+		/* wait for the next tick, giving up on any the game fell too
+		   far behind on rather than running them all at once */
+		add_ns( &next, 1000000000L / FPS );
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		if ( now.tv_sec - next.tv_sec > 1 ||
+		     ( now.tv_sec - next.tv_sec ) * 1000000000L +
+		     now.tv_nsec - next.tv_nsec >
+		     MAX_BEHIND * ( 1000000000L / FPS ) )
+			next = now;
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+	}
+	return NULL;
+}
+
+/*
+unsigned int start_game()
+---
+Starts a thread that calls game_tick() and publish_snapshot() FPS times a
+second, or IDLE_FPS times a second while there is nothing to play, and as soon
+as an input comes in
+---
+struct Game * g: game to run
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_game( struct Game * g )
+{
+        atomic_store( &g->quit, 0 );
+	if ( pthread_create( &g->thread, NULL, run_game, g ) != 0 ) {
+                fprintf( stderr, "Could not start game thread!\n" );
+		return 0;
+	}
+	g->started = 1;
+	return 1;
+}
+
+/*
+void stop_game()
+---
+Stops the game's thread, after the tick it is on
+---
+struct Game * g: game to stop
+*/
+void stop_game( struct Game * g )
+{
+        if ( !g->started )
+		return;
+	atomic_store( &g->quit, 1 );
+	pthread_mutex_lock( &g->lock );
+	pthread_cond_signal( &g->wake );
+	pthread_mutex_unlock( &g->lock );
+	pthread_join( g->thread, NULL );
+	g->started = 0;
+}
@@ -0,0 +1,328 @@
+#ifndef GAME_H_
+#define GAME_H_
+
+/**
+game.h
+---
+Header file for game.c, used to store all accessible functions related to
+running the game itself (levels, projectiles, the camera and the score) on a
+thread of its own, apart from the thread that draws it
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "structures.h"
+#include "loader.h"
+#include "watch.h"
+
+#define FPS (60) /* ticks a second while playing */
+#define IDLE_FPS (4) /* ticks a second on the menus, or with the window in the
+			background */
+#define MAX_SCORE (10000) /* max score for a level done with only 1 throw */
+#define MAX_BEHIND (10) /* ticks the game can fall behind before it gives up
+			   catching up */
+
+#define VIEW_W (640) /* size of the window, the part of the level in view */
+#define VIEW_H (480)
+#define CAMERA_EASE (0.1) /* how far the camera moves to its target each tick,
+			     as a fraction of the distance */
+
+#define INPUT_QUEUE_SZ (256) /* inputs waiting for the game, a power of 2 */
+#define GAME_LEVELS (4) /* the level being played, one being loaded, and up to
+			   2 in snapshots the drawing thread may hold */
+#define SNAPSHOTS (3) /* one being written, one being drawn, and the newest */
+#define SNAP_FRESH (4) /* set on the newest snapshot until it is taken */
+
+/* inputs to the game */
+#define INPUT_MOUSE (0) /* mouse moved to x,y in the window */
+#define INPUT_FIRE (1)  /* fire an arrow at the mouse */
+#define INPUT_START (2) /* leave the start menu */
+#define INPUT_FOCUS (3) /* window gained (x = 1) or lost (x = 0) focus */
+
+struct Replay; /* see replay.h */
+
+/* screens, see struct Game */
+#define SCREEN_GAME (0)
+#define SCREEN_MENU (1)
+#define SCREEN_END (2)
+
+/**
+struct Camera
+---
+Camera struct used to store which part of the level is in view
+---
+float x, y: top left corner of the view in the level (px)
+*/
+struct Camera {
+        float x;
+	float y;
+};
+
+/**
+struct Input
+---
+Something the player did, passed from the thread handling events to the game
+---
+unsigned int type: what was done (INPUT_*)
+float x, y: where, or the value of it (see INPUT_*)
+*/
+struct Input {
+        unsigned int type;
+	float x;
+	float y;
+};
+
+/**
+struct Input_queue
+---
+Ring of inputs with one thread adding to it and one taking from it. Neither
+ever waits for the other; head and tail are only written by one side each.
+---
+struct Input items[INPUT_QUEUE_SZ]: inputs, from tail up to head
+atomic_uint head: no. of inputs ever added, only written when adding
+atomic_uint tail: no. of inputs ever taken, only written when taking
+*/
+struct Input_queue {
+        struct Input items[INPUT_QUEUE_SZ];
+	atomic_uint head;
+	atomic_uint tail;
+};
+
+/**
+struct Snapshot
+---
+Copy of everything needed to draw one tick of the game. Once published by the
+game it is never changed until the drawing thread lets go of it, so it can be
+drawn while the game carries on.
+---
+unsigned long seq: no. of the snapshot, counting up from 1
+unsigned long version: moved on each time anything on the screen changes
+struct Level * level: level being played, NULL if none. Only read by the
+		      drawing thread, apart from its path cache, which only the
+		      drawing thread uses
+struct Proj_arr proj: positions of the projectiles in flight (x, y, px, py and
+		      count only)
+struct Position mouse: mouse position in the level
+struct Camera camera: part of the level in view
+unsigned int screen: SCREEN_* being shown
+unsigned int score: current score
+*/
+struct Snapshot {
+        unsigned long seq;
+	unsigned long version;
+	struct Level * level;
+	struct Proj_arr proj;
+	struct Position mouse;
+	struct Camera camera;
+	unsigned int screen;
+	unsigned int score;
+};
+
+/**
+struct Game
+---
+All the state of a game being played. Everything above the queue belongs to
+the game's thread (or whoever calls game_tick()), and is passed to the drawing
+thread through the snapshots, which are triple buffered: the game writes into
+back, then swaps it with middle, and the drawing thread swaps front with middle
+when middle is newer. Neither ever waits for the other.
+
+A level stays alive after the game is done with it until no snapshot the
+drawing thread may hold (any but back) points at it. With GAME_LEVELS slots
+there is always one free, so loading never waits on the drawing thread.
+---
+struct Level levels[GAME_LEVELS]: levels held by the game
+unsigned int used[GAME_LEVELS]: 1 for each level that holds anything
+struct Level * l: level being played, NULL if none
+struct Proj_arr proj: projectiles of the level
+struct Camera camera: part of the level in view
+struct Position mouse: mouse position in the level
+struct Position win_mouse: mouse position in the window
+struct Loader loader: loads the next level in the background
+struct Watch watch: reports edits to the level's files
+unsigned int curr_level: no. of the level being played
+unsigned int arrows_fired: no. of arrows fired in the level
+unsigned int score: current score
+unsigned int screen: SCREEN_* being shown
+unsigned int do_load: 1 if curr_level needs loading
+unsigned int reload: CHANGED_* flags of level files waiting to be reloaded
+unsigned int create_proj: 1 if an arrow is to be fired on the next tick
+unsigned int focused: 1 if the window has focus
+unsigned int loaded: 1 if a level was loaded this tick
+unsigned long version: see struct Snapshot
+unsigned long ticks: no. of ticks run
+unsigned long seq: no. of snapshots published
+struct Replay * rec: replay to record every input used to, NULL if none
+struct Replay * play: replay to play the inputs of, instead of any pushed
+		      (apart from INPUT_FOCUS). Set back to NULL once it ends
+struct Input_queue input: inputs waiting for the next tick
+struct Snapshot snaps[SNAPSHOTS]: triple buffer of snapshots
+unsigned int back: snapshot being written by the game
+unsigned int front: snapshot being drawn
+atomic_uint middle: newest snapshot, with SNAP_FRESH set until taken
+atomic_uint quit: 1 once the thread has to stop
+atomic_uint sleeping: 1 while the thread sleeps with nothing to play
+pthread_mutex_t lock: held while going to sleep, or waking the thread
+pthread_cond_t wake: signalled when an input comes in while sleeping, or on
+		     quit
+pthread_t thread: thread running the game
+unsigned int started: 1 if the thread is running
+*/
+struct Game {
+        struct Level levels[GAME_LEVELS];
+	unsigned int used[GAME_LEVELS];
+	struct Level * l;
+	struct Proj_arr proj;
+	struct Camera camera;
+	struct Position mouse;
+	struct Position win_mouse;
+	struct Loader loader;
+	struct Watch watch;
+	unsigned int curr_level;
+	unsigned int arrows_fired;
+	unsigned int score;
+	unsigned int screen;
+	unsigned int do_load;
+	unsigned int reload;
+	unsigned int create_proj;
+	unsigned int focused;
+	unsigned int loaded;
+	unsigned long version;
+	unsigned long ticks;
+	unsigned long seq;
+	struct Replay * rec;
+	struct Replay * play;
+
+	struct Input_queue input;
+	struct Snapshot snaps[SNAPSHOTS];
+	unsigned int back;
+	unsigned int front;
+	atomic_uint middle;
+	atomic_uint quit;
+	atomic_uint sleeping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+	unsigned int started;
+};
+
+/*
+void reset_camera()
+---
+Moves a camera straight to the player of a level
+---
+struct Camera * cam: camera to move
+struct Level * l: level being played
+*/
+void reset_camera( struct Camera *, struct Level * );
+
+/*
+void update_camera()
+---
+Eases a camera towards the arrow fired last, or back to the player once that
+arrow has stopped, keeping the view inside the level. Called once per tick.
+---
+struct Camera * cam: camera to move
+struct Level * l: level being played
+struct Proj_arr * p: projectiles of the level
+*/
+void update_camera( struct Camera *, struct Level *, struct Proj_arr * );
+
+/*
+unsigned int initialize_game()
+---
+Initializes a game on the start menu. The level to start on is loaded on its
+first tick; nothing runs until game_tick() is called, or the game's thread is
+started
+---
+struct Game * g: game to initialize
+unsigned int level: no. of the level to start on
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_game( struct Game *, unsigned int );
+
+/*
+void free_game()
+---
+Frees everything held by a game. Its thread must be stopped first
+---
+struct Game * g: game to free
+*/
+void free_game( struct Game * );
+
+/*
+unsigned int push_input()
+---
+Passes an input to the game, to be used on its next tick, waking the game's
+thread if it is sleeping. Only one thread may push inputs to a game
+---
+struct Game * g: game to pass the input to
+unsigned int type: INPUT_* type of the input
+float x, y: values of the input (see INPUT_*)
+---
+Returns 1 on success, 0 if the queue is full (the input is dropped)
+*/
+unsigned int push_input( struct Game *, unsigned int, float, float );
+
+/*
+void game_tick()
+---
+Runs the game on by one fixed tick: uses every input pushed since the last
+tick (or the inputs of the replay being played), loads or reloads levels,
+fires arrows, steps the projectiles and moves the camera, then checks for a
+win. The game depends on nothing but these inputs and the level files, so the
+same inputs on the same ticks always play out the same. Should only be called
+by one thread
+---
+struct Game * g: game to run
+*/
+void game_tick( struct Game * );
+
+/*
+void publish_snapshot()
+---
+Copies what is needed to draw the game as it is now into a snapshot, and makes
+it the newest one, to be taken by get_snapshot()
+---
+struct Game * g: game to publish
+*/
+void publish_snapshot( struct Game * );
+
+/*
+struct Snapshot * get_snapshot()
+---
+Gets the newest snapshot of a game for drawing. Until the next call, the game
+leaves it (and the level it points to) alone. Should only be called by the
+drawing thread
+---
+struct Game * g: game to get the snapshot of
+---
+Returns a struct Snapshot *, never NULL
+*/
+struct Snapshot * get_snapshot( struct Game * );
+
+/*
+unsigned int start_game()
+---
+Starts a thread that calls game_tick() and publish_snapshot() FPS times a
+second, or IDLE_FPS times a second while there is nothing to play, and as soon
+as an input comes in
+---
+struct Game * g: game to run
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_game( struct Game * );
+
+/*
+void stop_game()
+---
+Stops the game's thread, after the tick it is on
+---
+struct Game * g: game to stop
+*/
+void stop_game( struct Game * );
+
+#endif //GAME_H_
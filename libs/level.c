@@ -0,0 +1,766 @@
+/**
+level.c
+---
+File used to store all the functions to do with loading levels from the levels/
+directory. Needs no allegro, so can be used without a display.
+
+Functions that should not be accessed outside of this file are given the
+keyword 'static'.
+*/
+
+#include "level.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+static float n_strtof()
+---
+Converts a string token from a level file into a float
+---
+char * str: token to convert
+---
+Returns a float
+*/
+static float n_strtof( char * str )
+{
+        return (float)strtol( str, NULL, 10 );
+}
+
+/*
+static int chtoi()
+---
+Converts a given character to integer.
+---
+char ch: character to convert
+---
+Returns an integer
+*/
+static int chtoi( char ch )
+{
+        if (ch >= '0' && ch <= '9')
+                return ch - '0';
+        if (ch >= 'A' && ch <= 'F')
+                return ch - 'A' + 10;
+	else
+		return 16;
+}
+
+/*
+static char * map_file()
+---
+Maps a whole file into memory, copy-on-write so the mapping can be changed
+without touching the file. Used for level.bin, where the mapped bytes are used
+as they are.
+---
+char * loc: location of the file
+size_t * len: size of the file
+---
+Returns a pointer to the mapping (unmap with munmap()), NULL on fail or if the
+file is empty
+*/
+static char * map_file( char * loc, size_t * len )
+{
+        struct stat st;
+	char * data;
+	int fd = open( loc, O_RDONLY );
+
+	if ( fd < 0 )
+		return NULL;
+	if ( fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+                close( fd );
+		return NULL;
+	}
+	data = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		     fd, 0 );
+	/* the mapping stays valid once the file is closed */
+	close( fd );
+	if ( data == MAP_FAILED )
+		return NULL;
+	*len = st.st_size;
+	return data;
+}
+
+/**
+struct Tilemap_shape
+---
+What scan_tilemap() found in a tilemap file
+---
+size_t tiles: no. of tiles in the file
+unsigned int across: no. of tiles on the first line
+unsigned int down: no. of lines holding tiles
+unsigned int even: 1 if every line holds the same no. of tiles
+*/
+struct Tilemap_shape {
+        size_t tiles;
+	unsigned int across;
+	unsigned int down;
+	unsigned int even;
+};
+
+/*
+static void end_line()
+---
+Adds a line of a tilemap file to its shape, if it held any tiles
+---
+struct Tilemap_shape * sh: shape to add to
+size_t * line: no. of tiles on the line, reset to 0
+*/
+static void end_line( struct Tilemap_shape * sh, size_t * line )
+{
+        if ( *line == 0 )
+		return;
+	if ( sh->down == 0 )
+		sh->across = *line;
+	else if ( *line != sh->across )
+		sh->even = 0;
+	sh->down++;
+	*line = 0;
+}
+
+/*
+static unsigned int scan_tilemap()
+---
+Reads through a tilemap file in large chunks rather than a character at a
+time, finding its shape. If given a map, each character is also decoded into
+a tile index and stored, up to size tiles.
+---
+char * loc: location of the tilemap file
+char * map: where to store the tiles, NULL to only find the shape
+size_t size: no. of tiles map has room for
+struct Tilemap_shape * sh: shape of the file
+---
+Returns 1 on success, 0 if the file couldn't be read
+*/
+static unsigned int scan_tilemap( char * loc, char * map, size_t size,
+				  struct Tilemap_shape * sh )
+{
+        char buf[4096];
+	size_t line = 0;
+	ssize_t n;
+	int fd = open( loc, O_RDONLY );
+
+	sh->tiles = 0;
+	sh->across = 0;
+	sh->down = 0;
+	sh->even = 1;
+	if ( fd < 0 ) {
+                fprintf( stderr, "Could not open %s!\n", loc );
+		return 0;
+	}
+	while ( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 ) {
+                for ( ssize_t i = 0; i < n; i++ ) {
+                        if ( buf[i] == '\n' || buf[i] == '\r' ) {
+                                end_line( sh, &line );
+				continue;
+			}
+			/* stored decoded, so drawing doesn't have to */
+			if ( map != NULL && sh->tiles < size )
+				map[sh->tiles] = chtoi( buf[i] );
+			sh->tiles++;
+			line++;
+		}
+	}
+	end_line( sh, &line );
+	close( fd );
+	return n == 0;
+}
+
+/*
+unsigned int measure_tilemap()
+---
+Finds the size of the tilemap in a file. Each line of the file is a row of
+tiles, except for files with only one line, which are one screen (20x15) as
+all tilemaps used to be.
+---
+char * loc: location of the tilemap file
+unsigned int * rows, * cols: no. of tiles across and down, only set on success
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int measure_tilemap( char * loc, unsigned int * rows,
+			      unsigned int * cols )
+{
+        struct Tilemap_shape sh;
+
+	if ( !scan_tilemap( loc, NULL, 0, &sh ) )
+		return 0;
+	if ( sh.down == 1 ) {
+                if ( sh.tiles != 20 * 15 ) {
+                        fprintf( stderr, "%s should be %u tiles on one line, "
+				 "found %zu!\n", loc, 20 * 15, sh.tiles );
+			return 0;
+		}
+                *rows = 20;
+		*cols = 15;
+		return 1;
+	}
+	if ( !sh.even ) {
+                fprintf( stderr, "%s should have rows of tiles all the same "
+			 "length!\n", loc );
+		return 0;
+	}
+	*rows = sh.across;
+	*cols = sh.down;
+	return 1;
+}
+
+/*
+unsigned int load_tilemap()
+---
+Reads a tilemap file into an initialized tilemap, decoding each character into
+a tile index. The file must hold exactly one hex character per tile, either as
+one row of tiles per line or all on one line.
+---
+char * fg_loc: location of the tilemap file
+struct Tilemap * tm: tilemap to store the tiles in
+---
+Returns 1 on success, 0 on fail (the tilemap is left with no tiles)
+*/
+unsigned int load_tilemap( char * fg_loc, struct Tilemap * tm )
+{
+        struct Tilemap_shape sh;
+	unsigned int ok = scan_tilemap( fg_loc, tm->map, tm->size, &sh );
+
+	if ( ok && ( sh.tiles != tm->size ||
+		     ( sh.down > 1 && ( !sh.even || sh.across != tm->rows ||
+					sh.down != tm->cols ) ) ) ) {
+                fprintf( stderr, "%s should be %ux%u tiles, found %zu!\n",
+			 fg_loc, tm->rows, tm->cols, sh.tiles );
+		ok = 0;
+	}
+	if ( !ok )
+		memset( tm->map, 16, tm->size );
+	return ok;
+}
+
+/*
+static unsigned int has_target()
+---
+Checks if a level has a target trigger among its objects
+---
+struct Level * l: level to check
+---
+Returns an unsigned int, 1 if it has, 0 if not
+*/
+static unsigned int has_target( struct Level * l )
+{
+        for ( unsigned int i = 0; i < l->index; i++ ) {
+                if ( l->object_arr[i].type == OBJ_TARGET )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+unsigned int parse_level_file()
+---
+Parses a level.txt file, initializing the level from its first 4 lines and
+adding an object for each line after that. Objects with a type of OBJ_TRIGGER
+or more are trigger volumes. If none of them is an OBJ_TARGET, a TARGET_SZ
+target is added at the target position, as older levels only give that
+---
+char * level_loc: location of the level file
+struct Level * l: level to initialize
+int num: number of the level
+---
+Returns 1 on success, 0 on fail (the level is still initialized, empty, so
+it can be freed as normal)
+*/
+unsigned int parse_level_file( char * level_loc, struct Level * l, int num )
+{
+        FILE* file_pntr = fopen(level_loc, "r");
+	unsigned int ok = 0;/* if the first 4 lines were read */
+	int l_index = 0;
+	int t_index = 0;
+	size_t len = 0;
+	ssize_t read;/* length of gotten line */
+	char* line = NULL;/* null pointer */
+        char* token;
+	char* save;/* strtok_r() state, so levels can load on any thread */
+	char* delim = ",";
+	/* for level parsing */
+	float startx, starty, targetx, targety,
+	      windx, windy, gravx, gravy, f_tok;
+	/* for object parsing */
+        struct Object o;
+	float posx,posy,dimx,dimy,type;
+	if ( file_pntr == NULL ) {
+                fprintf( stderr, "Could not open %s!\n", level_loc );
+		initialize_level( l, 0, 0, 0, 0, 0, 0, 0, 0, num );
+		return 0;
+	}
+	/* read each line in the file*/
+        while ( (read = getline(&line, &len, file_pntr)) != -1 ) {
+                t_index = 0;
+		/* split each line into tokens */
+		token = strtok_r(line, delim, &save);
+		while (token != NULL) {
+			/* turn string token into float */
+			f_tok = n_strtof( token );
+
+			/* check which line of the file it is */
+                        switch (l_index) {
+                        case 0:                         //line 0, start pos
+				if (t_index++ == 0)
+					startx = f_tok;
+				else
+					starty = f_tok;
+				break;
+                        case 1:                         //line 1, target pos
+				if (t_index++ == 0)
+					targetx = f_tok;
+				else
+					targety = f_tok;
+				break;
+			case 2:                         //line 2, wind vel
+				if (t_index++ == 0)
+					windx = f_tok;
+				else
+					windy = f_tok;
+				break;
+                        case 3:                         //line 3, grav vel
+				if (t_index++ == 0)
+					gravx = f_tok;
+				else if (!ok) {
+					gravy = f_tok;
+				        initialize_level( l, startx, starty,
+							  targetx, targety,
+							  windx, windy,
+							  gravx, gravy, num);
+					ok = 1;
+				}
+				break;
+                        default:                        //else, must be object
+                                /* check which token it is */
+				switch (t_index++) {
+                                case 0:                         //x pos
+					posx = f_tok;
+					break;
+                                case 1:                         //y pos
+					posy = f_tok;
+					break;
+				case 2:                         //width
+					dimx = f_tok;
+					break;
+				case 3:                         //height
+					dimy = f_tok;
+					break;
+				case 4:                         //type
+					type = f_tok;
+					initialize_object(&o, posx, posy,
+							  dimx, dimy,
+							  type, 0, 0, 0);
+					if (ok)
+						add_object_to_level(l, o);
+					break;
+				default:
+					break;
+				}
+			        break;
+			}
+			/* get next token */
+			token = strtok_r(NULL, delim, &save);
+		}
+		l_index++;	
+	}
+	free(line);
+	fclose(file_pntr);
+
+	if (!ok) {
+		fprintf( stderr, "%s is missing level settings!\n",
+			 level_loc );
+		initialize_level( l, 0, 0, 0, 0, 0, 0, 0, 0, num );
+	} else if ( !has_target( l ) ) {
+                initialize_object( &o, l->target_pos.x, l->target_pos.y,
+				   TARGET_SZ, TARGET_SZ, OBJ_TARGET, 0, 0, 0 );
+		add_object_to_level( l, o );
+	}
+	return ok;
+}
+
+/*
+static uint32_t fnv1a()
+---
+Hashes a block of memory with 32 bit FNV-1a, used as the checksum of level.bin
+---
+const char * data: memory to hash
+size_t len: no. of bytes to hash
+---
+Returns a uint32_t, the hash
+*/
+static uint32_t fnv1a( const char * data, size_t len )
+{
+        uint32_t h = 2166136261u;
+	for ( size_t i = 0; i < len; i++ ) {
+                h ^= (unsigned char)data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+static unsigned int is_newer()
+---
+Checks if a file was modified after another
+---
+char * a: file that should be newer
+char * b: file to compare against
+---
+Returns an unsigned int, 1 if a exists and b is older or missing, 0 if not
+*/
+static unsigned int is_newer( char * a, char * b )
+{
+        struct stat sa, sb;
+	if ( stat( a, &sa ) != 0 )
+		return 0;
+	if ( stat( b, &sb ) != 0 )
+		return 1;
+	return sa.st_mtime > sb.st_mtime;
+}
+
+/*
+void load_level_txt()
+---
+Loads a given level from its text files (level.txt, fg.txt, bg.txt and
+dec.txt) and initializes the level accordingly
+---
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void load_level_txt( struct Level * l, int num )
+{
+        unsigned int rows = 20, cols = 15;
+	char level_loc[32];
+	char fg_loc[32];
+	char bg_loc[32];
+	char dec_loc[32];
+	
+	/* edit file locs */
+	snprintf(level_loc, 32, "levels/%i/level.txt", num);
+	snprintf(fg_loc, 32, "levels/%i/fg.txt", num);
+	snprintf(bg_loc, 32, "levels/%i/bg.txt", num);
+	snprintf(dec_loc, 32, "levels/%i/dec.txt", num);
+	
+	/* parse level.txt, which starts the level's arena */
+        parse_level_file( level_loc, l, num );
+
+        /* load tilemaps, all the size of fg (one screen if fg is bad) */
+	measure_tilemap( fg_loc, &rows, &cols );
+	initialize_level_tilemap( l, &l->fg, rows, cols );
+	initialize_level_tilemap( l, &l->bg, rows, cols );
+	initialize_level_tilemap( l, &l->dec, rows, cols );
+        load_tilemap( fg_loc, &l->fg );
+	load_tilemap( bg_loc, &l->bg );
+	load_tilemap( dec_loc, &l->dec );
+	l->width = rows * TILE_SZ;
+	l->height = cols * TILE_SZ;
+
+	/* build collision grid over the tilemap */
+	initialize_grid( l, l->fg.rows, l->fg.cols );
+}
+
+/*
+unsigned int load_level_bin()
+---
+Loads a level from a compiled level.bin. The file is mapped whole and checked
+(magic, version, sizes and checksum), then the level's objects and tilemaps
+are pointed into the mapping rather than copied, see struct Level_header.
+The mapping is owned by the level's arena.
+---
+char * loc: location of the level.bin
+int num: number of the level
+---
+Returns 1 on success, 0 on fail (the level is left untouched)
+*/
+unsigned int load_level_bin( char * loc, struct Level * l, int num )
+{
+        size_t len;
+	char * blob = map_file( loc, &len );
+	struct Level_header * h;
+	
+	if ( blob == NULL )
+		return 0;
+	if ( len < sizeof( struct Level_header ) ) {
+                fprintf( stderr, "%s is too small!\n", loc );
+		munmap( blob, len );
+		return 0;
+	}
+
+	/* check it is a level.bin this build can use as it is */
+	h = (struct Level_header *)blob;
+	size_t tiles = (size_t)h->rows * h->cols;
+	if ( memcmp( h->magic, LEVEL_MAGIC, 4 ) != 0 ||
+	     h->version != LEVEL_VERSION ||
+	     h->object_sz != sizeof( struct Object ) ||
+	     h->size != len - sizeof( struct Level_header ) ||
+	     h->size != h->n_objects * sizeof( struct Object ) + tiles * 3 ||
+	     h->rows == 0 || h->cols == 0 ) {
+                fprintf( stderr, "%s is not a valid level!\n", loc );
+		munmap( blob, len );
+		return 0;
+	}
+	if ( fnv1a( blob + sizeof( struct Level_header ), h->size ) !=
+	     h->checksum ) {
+                fprintf( stderr, "%s is corrupt!\n", loc );
+		munmap( blob, len );
+		return 0;
+	}
+
+	initialize_level( l, h->start_x, h->start_y, h->target_x, h->target_y,
+			  h->wind_x, h->wind_y, h->gravity_x, h->gravity_y,
+			  num );
+	if ( !arena_add_map( &l->arena, blob, len ) ) {
+                free_level( l );
+		munmap( blob, len );
+		return 0;
+	}
+
+	/* point into the file rather than copying out of it */
+	char * data = blob + sizeof( struct Level_header );
+	l->object_arr = (struct Object *)data;
+	l->size = h->n_objects;
+	l->index = h->n_objects;
+	data += h->n_objects * sizeof( struct Object );
+
+	struct Tilemap * tms[3] = { &l->fg, &l->bg, &l->dec };
+	for ( int i = 0; i < 3; i++ ) {
+		tms[i]->rows = h->rows;
+		tms[i]->cols = h->cols;
+		tms[i]->size = tiles;
+		tms[i]->map = data;
+		tms[i]->owned = 0;
+		data += tiles;
+	}
+	l->width = h->rows * TILE_SZ;
+	l->height = h->cols * TILE_SZ;
+	return 1;
+}
+
+/*
+unsigned int write_level_bin()
+---
+Writes a loaded level out as a compiled level.bin, see struct Level_header.
+The fg, bg and dec tilemaps must all be the same size. The file is written
+next to loc first then renamed over it, so a game with the old file mapped
+(see load_level_bin()) keeps reading the old one rather than crashing.
+---
+struct Level * l: level to write
+char * loc: where to write the level.bin
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int write_level_bin( struct Level * l, char * loc )
+{
+        struct Level_header h;
+	size_t objs = l->index * sizeof( struct Object );
+	size_t tiles = l->fg.size;
+	char * data;
+	char tmp_loc[256];
+	FILE * f;
+
+	if ( snprintf( tmp_loc, sizeof( tmp_loc ), "%s.tmp", loc ) >=
+	     (int)sizeof( tmp_loc ) ) {
+                fprintf( stderr, "Path too long: %s\n", loc );
+		return 0;
+	}
+	if ( l->bg.size != tiles || l->dec.size != tiles ) {
+                fprintf( stderr, "Tilemaps of level %u differ in size!\n",
+			 l->level );
+		return 0;
+	}
+
+	/* gather everything after the header, to checksum it */
+	data = malloc( objs + tiles * 3 );
+	if ( data == NULL ) {
+                fprintf( stderr, "Could not allocate %s!\n", loc );
+		return 0;
+	}
+	memcpy( data, l->object_arr, objs );
+	memcpy( data + objs, l->fg.map, tiles );
+	memcpy( data + objs + tiles, l->bg.map, tiles );
+	memcpy( data + objs + tiles * 2, l->dec.map, tiles );
+
+	memset( &h, 0, sizeof( h ) );
+	memcpy( h.magic, LEVEL_MAGIC, 4 );
+	h.version = LEVEL_VERSION;
+	h.size = objs + tiles * 3;
+	h.checksum = fnv1a( data, h.size );
+	h.object_sz = sizeof( struct Object );
+	h.n_objects = l->index;
+	h.rows = l->fg.rows;
+	h.cols = l->fg.cols;
+	h.start_x = l->start_pos.x;
+	h.start_y = l->start_pos.y;
+	h.target_x = l->target_pos.x;
+	h.target_y = l->target_pos.y;
+	h.wind_x = l->wind.x;
+	h.wind_y = l->wind.y;
+	h.gravity_x = l->gravity.x;
+	h.gravity_y = l->gravity.y;
+
+	f = fopen( tmp_loc, "wb" );
+	if ( f == NULL || fwrite( &h, sizeof( h ), 1, f ) != 1 ||
+	     fwrite( data, 1, h.size, f ) != h.size || fflush( f ) != 0 ) {
+                fprintf( stderr, "Could not write %s!\n", tmp_loc );
+		if ( f != NULL ) {
+                        fclose( f );
+			remove( tmp_loc );
+		}
+		free( data );
+		return 0;
+	}
+	free( data );
+	if ( fclose( f ) != 0 || rename( tmp_loc, loc ) != 0 ) {
+                fprintf( stderr, "Could not write %s!\n", loc );
+		remove( tmp_loc );
+		return 0;
+	}
+	return 1;
+}
+
+/*
+void load_level()
+---
+Loads a given level according to its level number and initializes the 
+level accordingly. The compiled levels/N/level.bin is used if it is newer than
+every text file of the level, otherwise the text files are parsed.
+---
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void load_level( struct Level * l, int num )
+{
+        char bin_loc[32];
+	char txt_loc[32];
+	const char * txts[4] = { "level", "fg", "bg", "dec" };
+	unsigned int use_bin = 1;
+	
+	/* if num is invalid, default to level 1 */
+	if (num > LAST_LEVEL || num < 1)
+		num = 1;
+
+	snprintf( bin_loc, 32, "levels/%i/level.bin", num );
+	for ( int i = 0; i < 4 && use_bin; i++ ) {
+                snprintf( txt_loc, 32, "levels/%i/%s.txt", num, txts[i] );
+		use_bin = is_newer( bin_loc, txt_loc );
+	}
+
+	if ( use_bin && load_level_bin( bin_loc, l, num ) ) {
+                /* build collision grid over the tilemap */
+                initialize_grid( l, l->fg.rows, l->fg.cols );
+		return;
+	}
+	load_level_txt( l, num );
+}
+
+/*
+static void copy_tilemap()
+---
+Fills a tilemap of a level being reloaded, from its file if it changed, or
+from the same tilemap of the old level otherwise. A bad file leaves the old
+tiles as they were.
+---
+char * loc: location of the tilemap file, NULL if it didn't change
+struct Tilemap * tm: tilemap to fill, the same size as old
+struct Tilemap * old: tilemap of the old level
+---
+Returns 1 if loaded from the file, 0 if copied
+*/
+static unsigned int copy_tilemap( char * loc, struct Tilemap * tm,
+				  struct Tilemap * old )
+{
+        if ( loc != NULL && load_tilemap( loc, tm ) )
+		return 1;
+	memcpy( tm->map, old->map, tm->size );
+	return 0;
+}
+
+/*
+static unsigned int copy_objects()
+---
+Initializes a level being reloaded with the objects, start and target
+positions, wind and gravity of the old level, the same as a level.txt would
+---
+struct Level * l: level to initialize
+struct Level * old: level to copy from
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int copy_objects( struct Level * l, struct Level * old )
+{
+        initialize_level( l, old->start_pos.x, old->start_pos.y,
+			  old->target_pos.x, old->target_pos.y, old->wind.x,
+			  old->wind.y, old->gravity.x, old->gravity.y,
+			  old->level );
+	if ( old->index == 0 )
+		return 1;
+
+	l->object_arr = arena_alloc( &l->arena,
+				     old->index * sizeof( struct Object ) );
+	if ( l->object_arr == NULL )
+		return 0;
+	memcpy( l->object_arr, old->object_arr,
+		old->index * sizeof( struct Object ) );
+	l->size = old->index;
+	l->index = old->index;
+	return 1;
+}
+
+/*
+unsigned int reload_level()
+---
+Builds a new level from a loaded one and the files of it that changed on disk.
+A changed tilemap file only reloads that tilemap, while a changed level.txt
+only reloads the objects and level settings; everything else is copied from
+the old level, which is left as it is. The new level has an arena of its own,
+so reloading over and over doesn't pile up old objects and tilemaps anywhere.
+---
+struct Level * l: level to build, freed as normal
+struct Level * old: level to reload
+unsigned int changed: CHANGED_* flags of the files to reload
+---
+Returns an unsigned int, CHANGED_* flags of the files reloaded
+*/
+unsigned int reload_level( struct Level * l, struct Level * old,
+			   unsigned int changed )
+{
+        const char * names[4] = { "level", "fg", "bg", "dec" };
+	struct Tilemap * tms[4] = { NULL, &l->fg, &l->bg, &l->dec };
+	struct Tilemap * olds[4] = { NULL, &old->fg, &old->bg, &old->dec };
+	unsigned int done = 0;
+	char loc[32];
+
+	/* parsed straight into the new level, a bad file keeps the old
+	   objects */
+	snprintf( loc, 32, "levels/%u/level.txt", old->level );
+	if ( changed & CHANGED_LEVEL ) {
+                if ( parse_level_file( loc, l, old->level ) ) {
+                        done |= CHANGED_LEVEL;
+		} else {
+                        fprintf( stderr, "Could not reload %s!\n", loc );
+			free_level( l );
+		}
+	}
+	if ( !( done & CHANGED_LEVEL ) )
+		copy_objects( l, old );
+
+	/* tilemaps stay the size they were */
+	for ( int i = 1; i < 4; i++ ) {
+                if ( !initialize_level_tilemap( l, tms[i], olds[i]->rows,
+						olds[i]->cols ) )
+			continue;
+		snprintf( loc, 32, "levels/%u/%s.txt", old->level, names[i] );
+		if ( copy_tilemap( changed & ( 1u << i ) ? loc : NULL, tms[i],
+				   olds[i] ) )
+			done |= 1u << i;
+	}
+	l->width = old->width;
+	l->height = old->height;
+
+	initialize_grid( l, old->grid.w, old->grid.h );
+	return done;
+}
@@ -0,0 +1,141 @@
+#ifndef LEVEL_H_
+#define LEVEL_H_
+
+/**
+level.h
+---
+Header file for level.c, used to store all accessible functions related to
+loading levels
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "structures.h"
+#include "physics.h"
+
+#define LAST_LEVEL (8)
+#define LEVEL_MAGIC "MDLV" /* first 4 bytes of a level.bin */
+#define LEVEL_VERSION (2)   /* bumped whenever the level.bin layout, or what
+			       goes in it, changes */
+
+/* files of a level, as flags for reload_level() */
+#define CHANGED_LEVEL (1)   /* level.txt */
+#define CHANGED_FG (2)      /* fg.txt */
+#define CHANGED_BG (4)      /* bg.txt */
+#define CHANGED_DEC (8)     /* dec.txt */
+
+/*
+unsigned int measure_tilemap()
+---
+Finds the size of the tilemap in a file. Each line of the file is a row of
+tiles, except for files with only one line, which are one screen (20x15) as
+all tilemaps used to be.
+---
+char * loc: location of the tilemap file
+unsigned int * rows, * cols: no. of tiles across and down, only set on success
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int measure_tilemap( char *, unsigned int *, unsigned int * );
+
+/*
+unsigned int load_tilemap()
+---
+Reads a tilemap file into an initialized tilemap, decoding each character into
+a tile index. The file must hold exactly one hex character per tile, either as
+one row of tiles per line or all on one line.
+---
+char * fg_loc: location of the tilemap file
+struct Tilemap * tm: tilemap to store the tiles in
+---
+Returns 1 on success, 0 on fail (the tilemap is left with no tiles)
+*/
+unsigned int load_tilemap( char *, struct Tilemap * );
+
+/*
+unsigned int parse_level_file()
+---
+Parses a level.txt file, initializing the level from its first 4 lines and
+adding an object for each line after that. Objects with a type of OBJ_TRIGGER
+or more are trigger volumes. If none of them is an OBJ_TARGET, a TARGET_SZ
+target is added at the target position, as older levels only give that
+---
+char * level_loc: location of the level file
+struct Level * l: level to initialize
+int num: number of the level
+---
+Returns 1 on success, 0 on fail (the level is still initialized, empty, so
+it can be freed as normal)
+*/
+unsigned int parse_level_file( char *, struct Level *, int );
+
+/*
+void load_level_txt()
+---
+Loads a given level from its text files (level.txt, fg.txt, bg.txt and
+dec.txt) and initializes the level accordingly
+---
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void load_level_txt( struct Level *, int );
+
+/*
+unsigned int load_level_bin()
+---
+Loads a level from a compiled level.bin. The file is mapped whole and checked
+(magic, version, sizes and checksum), then the level's objects and tilemaps
+are pointed into the mapping rather than copied, see struct Level_header.
+The mapping is owned by the level's arena.
+---
+char * loc: location of the level.bin
+int num: number of the level
+---
+Returns 1 on success, 0 on fail (the level is left untouched)
+*/
+unsigned int load_level_bin( char *, struct Level *, int );
+
+/*
+unsigned int write_level_bin()
+---
+Writes a loaded level out as a compiled level.bin, see struct Level_header.
+The fg, bg and dec tilemaps must all be the same size.
+---
+struct Level * l: level to write
+char * loc: where to write the level.bin
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int write_level_bin( struct Level *, char * );
+
+/*
+void load_level()
+---
+Loads a given level according to its level number and initializes the 
+level accordingly. The compiled levels/N/level.bin is used if it is newer than
+every text file of the level, otherwise the text files are parsed.
+---
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void load_level( struct Level *, int );
+
+/*
+unsigned int reload_level()
+---
+Builds a new level from a loaded one and the files of it that changed on disk.
+A changed tilemap file only reloads that tilemap, while a changed level.txt
+only reloads the objects and level settings; everything else is copied from
+the old level, which is left as it is. The new level has an arena of its own,
+so reloading over and over doesn't pile up old objects and tilemaps anywhere.
+---
+struct Level * l: level to build, freed as normal
+struct Level * old: level to reload
+unsigned int changed: CHANGED_* flags of the files to reload
+---
+Returns an unsigned int, CHANGED_* flags of the files reloaded
+*/
+unsigned int reload_level( struct Level *, struct Level *, unsigned int );
+
+#endif //LEVEL_H_
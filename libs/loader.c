@@ -0,0 +1,163 @@
+/**
+loader.c
+---
+File used to store the background level loader. While a level is played, the
+next one is loaded on another thread, so winning a level only has to hand over
+a struct Level that is already filled in. Needs no allegro; anything that does
+(like baking the layers) is left to the thread that takes the level.
+
+Functions that should not be accessed outside of this file are given the
+keyword 'static'.
+*/
+
+#include "loader.h"
+#include "level.h"
+
+/*
+static void * run_loader()
+---
+Body of the loader thread. Sleeps until a level is wanted, loads it with the
+lock released, then leaves it in ready for take_level()
+---
+void * arg: struct Loader * to serve
+---
+Returns NULL
+*/
+static void * run_loader( void * arg )
+{
+        struct Loader * ld = arg;
+	struct Level l;
+	int num;
+
+	pthread_mutex_lock( &ld->lock );
+	while ( !ld->quit ) {
+                if ( ld->want == 0 || ld->want == ld->ready_num ) {
+                        ld->want = 0;
+			pthread_cond_wait( &ld->cond, &ld->lock );
+			continue;
+		}
+		num = ld->want;
+		ld->want = 0;
+		ld->busy = num;
+		pthread_mutex_unlock( &ld->lock );
+
+		load_level( &l, num );
+
+		pthread_mutex_lock( &ld->lock );
+		if ( ld->ready_num != 0 )
+			free_level( &ld->ready );
+		ld->ready = l;
+		ld->ready_num = num;
+		ld->busy = 0;
+		pthread_cond_broadcast( &ld->cond );
+	}
+	pthread_mutex_unlock( &ld->lock );
+	return NULL;
+}
+
+/*
+unsigned int start_loader()
+---
+Initializes a loader and starts its thread. If the thread can't be started,
+take_level() still works, it just loads on the calling thread
+---
+struct Loader * ld: loader to start
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_loader( struct Loader * ld )
+{
+        pthread_mutex_init( &ld->lock, NULL );
+	pthread_cond_init( &ld->cond, NULL );
+	ld->want = 0;
+	ld->busy = 0;
+	ld->ready_num = 0;
+	ld->quit = 0;
+	ld->started = 0;
+
+	if ( pthread_create( &ld->thread, NULL, run_loader, ld ) != 0 ) {
+                fprintf( stderr, "Could not start level loader!\n" );
+		return 0;
+	}
+	ld->started = 1;
+	return 1;
+}
+
+/*
+void prefetch_level()
+---
+Asks the loader to start loading a level in the background. Any level loaded
+before that hasn't been taken is thrown away
+---
+struct Loader * ld: loader to use
+int num: number of the level
+*/
+void prefetch_level( struct Loader * ld, int num )
+{
+        if ( !ld->started )
+		return;
+
+	pthread_mutex_lock( &ld->lock );
+	if ( ld->ready_num != 0 && ld->ready_num != num ) {
+                free_level( &ld->ready );
+		ld->ready_num = 0;
+	}
+	ld->want = num;
+	pthread_cond_broadcast( &ld->cond );
+	pthread_mutex_unlock( &ld->lock );
+}
+
+/*
+void take_level()
+---
+Gets a loaded level, with its tilemaps. If the loader has it ready, the level
+is handed over as is, with no loading done. If the loader is still on it, this
+waits for it to finish. Otherwise the level is loaded on the calling thread.
+The level is owned by the caller from then on
+---
+struct Loader * ld: loader to use
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void take_level( struct Loader * ld, struct Level * l, int num )
+{
+        if ( ld->started ) {
+                pthread_mutex_lock( &ld->lock );
+		while ( ld->ready_num != num &&
+			( ld->busy == num || ld->want == num ) )
+			pthread_cond_wait( &ld->cond, &ld->lock );
+		if ( ld->ready_num == num ) {
+                        *l = ld->ready;
+			ld->ready_num = 0;
+			pthread_mutex_unlock( &ld->lock );
+			return;
+		}
+		pthread_mutex_unlock( &ld->lock );
+	}
+	load_level( l, num );
+}
+
+/*
+void stop_loader()
+---
+Stops the loader thread and frees any level it still holds
+---
+struct Loader * ld: loader to stop
+*/
+void stop_loader( struct Loader * ld )
+{
+        if ( ld->started ) {
+                pthread_mutex_lock( &ld->lock );
+		ld->quit = 1;
+		pthread_cond_broadcast( &ld->cond );
+		pthread_mutex_unlock( &ld->lock );
+		pthread_join( ld->thread, NULL );
+		ld->started = 0;
+	}
+	if ( ld->ready_num != 0 ) {
+                free_level( &ld->ready );
+		ld->ready_num = 0;
+	}
+	pthread_mutex_destroy( &ld->lock );
+	pthread_cond_destroy( &ld->cond );
+}
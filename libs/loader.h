@@ -0,0 +1,89 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+/**
+loader.h
+---
+Header file for loader.c, used to store all accessible functions related to
+loading levels ahead of time on a background thread
+*/
+
+#include <pthread.h>
+
+#include "structures.h"
+
+/**
+struct Loader
+---
+Background loader, which keeps one level loaded ahead of the one being played
+so changing level doesn't stall a frame on disk and parsing.
+---
+pthread_t thread: loader thread
+pthread_mutex_t lock: held while reading or changing anything below
+pthread_cond_t cond: signalled when want, ready_num or quit changes
+int want: no. of the level to load next, 0 if none
+int busy: no. of the level being loaded, 0 if none
+int ready_num: no. of the level in ready, 0 if none
+struct Level ready: loaded level waiting to be taken
+unsigned int quit: 1 once the thread has to stop
+unsigned int started: 1 if thread is running
+*/
+struct Loader {
+        pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int want;
+	int busy;
+	int ready_num;
+	struct Level ready;
+	unsigned int quit;
+	unsigned int started;
+};
+
+/*
+unsigned int start_loader()
+---
+Initializes a loader and starts its thread. If the thread can't be started,
+take_level() still works, it just loads on the calling thread
+---
+struct Loader * ld: loader to start
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_loader( struct Loader * );
+
+/*
+void prefetch_level()
+---
+Asks the loader to start loading a level in the background. Any level loaded
+before that hasn't been taken is thrown away
+---
+struct Loader * ld: loader to use
+int num: number of the level
+*/
+void prefetch_level( struct Loader *, int );
+
+/*
+void take_level()
+---
+Gets a loaded level, with its tilemaps. If the loader has it ready, the level
+is handed over as is, with no loading done. If the loader is still on it, this
+waits for it to finish. Otherwise the level is loaded on the calling thread.
+The level is owned by the caller from then on
+---
+struct Loader * ld: loader to use
+struct Level * l: level to store loaded data in
+int num: number of the level
+*/
+void take_level( struct Loader *, struct Level *, int );
+
+/*
+void stop_loader()
+---
+Stops the loader thread and frees any level it still holds
+---
+struct Loader * ld: loader to stop
+*/
+void stop_loader( struct Loader * );
+
+#endif //LOADER_H_
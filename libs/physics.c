@@ -10,6 +10,10 @@ keyword 'static'.
 
 #include "physics.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 
 /*
 void get_velocity_from_mouse()
@@ -44,24 +48,132 @@ is in a separate function from is_collide() in order to be called if a level
 has no objects to iterate through (only for testing purposes)
 ---
 struct Position * pos; pos of the projectile
+struct Level * l: level the projectile is in
 ---
 Returns an unsigned int, 1 if oob, 0 if not
 */
-static unsigned int is_oob( struct Position * pos )
+static unsigned int is_oob( struct Position * pos, struct Level * l )
 {
-        if ( (pos->x <= 0 || pos->x >= 640) ||
-	     (pos->y <= 0 || pos->y >= 480) )
+        if ( (pos->x <= 0 || pos->x >= l->width) ||
+	     (pos->y <= 0 || pos->y >= l->height) )
 		return 1;
 	return 0;
 }
 
+/*
+unsigned int is_in_object()
+---
+Checks if a given position is within the bounds of an object (edges included)
+---
+struct Position * pos: position to check
+struct Object * o: object to check against
+---
+Returns an unsigned int, 1 if inside, 0 if not
+*/
+static unsigned int is_in_object( struct Position * pos, struct Object * o )
+{
+	float min_x = o->pos.x;
+	float max_x = o->pos.x + o->dims.x;
+	float min_y = o->pos.y - o->dims.y;
+	float max_y = o->pos.y;
+
+	if ( (pos->x >= min_x && pos->x <= max_x) &&
+	     (pos->y >= min_y && pos->y <= max_y) )
+		return 1;
+	return 0;
+}
+
+/*
+static unsigned int hit_object()
+---
+Checks if a point hits an object. Trigger volumes are never hit, but the first
+one the point is within is kept
+---
+struct Position * pos: position to check
+struct Level * l: level with the object
+unsigned int i: index of the object in object_arr
+int * trig: index of the first trigger pos is within, changed from -1 if this
+            is it
+---
+Returns an unsigned int, 1 if hit, 0 if not,
+returns int * trig [implicit].
+*/
+static unsigned int hit_object( struct Position * pos, struct Level * l,
+				unsigned int i, int * trig )
+{
+        if ( !is_in_object( pos, &l->object_arr[i] ) )
+		return 0;
+	if ( l->object_arr[i].type < OBJ_TRIGGER )
+		return 1;
+	if ( *trig < 0 )
+		*trig = i;
+	return 0;
+}
+
+/*
+static unsigned int collide_point()
+---
+Same as is_collide(), but also finds the first trigger volume pos is within
+---
+struct Position * pos: position the projectile is at
+struct Level * l: level the projectile is in
+int * trig: index in object_arr of the first trigger pos is within, left as it
+            is if there are none
+---
+Returns an unsigned int, same as is_collide(),
+returns int * trig [implicit].
+*/
+static unsigned int collide_point( struct Position * pos, struct Level * l,
+				   int * trig )
+{
+	/* if projectile out of level bounds (only if there are objects) */
+	if ( l->index > 0 && is_oob(pos, l) )
+		return 0;
+
+	/* no grid, so check every object */
+	if ( l->grid.start == NULL ) {
+                for ( unsigned int i = 0; i < l->index; i++ ) {
+                        if ( hit_object( pos, l, i, trig ) )
+				return l->object_arr[i].type;
+		}
+		return -1;
+	}
+
+	/* figure out which cell pos is in, clamped the same way objects are
+	   when the grid is built */
+	int cx = floorf( pos->x / CELL_SZ );
+	int cy = floorf( pos->y / CELL_SZ );
+	if ( cx < 0 )
+		cx = 0;
+	if ( cx >= (int)l->grid.w )
+		cx = l->grid.w - 1;
+	if ( cy < 0 )
+		cy = 0;
+	if ( cy >= (int)l->grid.h )
+		cy = l->grid.h - 1;
+	unsigned int cell = cy * l->grid.w + cx;
+	
+        /* iterate through the objects in the cell */
+	unsigned int i;
+	for ( unsigned int j = l->grid.start[cell];
+	      j < l->grid.start[cell + 1]; j++ ) {
+		i = l->grid.items[j];
+		if ( hit_object( pos, l, i, trig ) )
+			return l->object_arr[i].type;
+	}
+
+	return -1;
+}
+
 /*
 unsigned int is_collide()
 ---
 Checks if a projectile at position (pos) collides with any of the objects in
-the level. this is done by iterating through all the objects on object_arr,
-figuring out bounds and checking if the projectile is within any of the bounds.
-Also checks if the projectile is out of bounds of the window
+the level. If the level has a grid, only the objects in the cell containing
+pos are checked, otherwise this is done by iterating through all the objects
+on object_arr. Either way the first object in object_arr that pos is within
+is the one used. Trigger volumes are passed through.
+Also checks if the projectile is out of bounds of the level
 ---
 struct Position * pos: position the projectile is at ( stored as float )
 struct Level * l: level the projectile is in, stores the object_arr
@@ -73,39 +185,10 @@ Returns an unsigned int, -1 if no collision, type of object if collision,
 This is because objects can have type 0, which leads to confusion when parsing
 the result.
 */
-static unsigned int is_collide( struct Position * pos, struct Level * l )
+unsigned int is_collide( struct Position * pos, struct Level * l )
 {
-	float min_x, min_y, max_x, max_y;
-	unsigned int return_type = -1;
-        /* iterate through object_arr */
-	unsigned int brk = 0;
-	int i = 0;
-	while ( !brk && i < l->index ) {
-                /* figure out bounds of current object */
-		min_x = l->object_arr[i].pos.x;
-		max_x = l->object_arr[i].pos.x + l->object_arr[i].dims.x;
-
-		min_y = l->object_arr[i].pos.y - l->object_arr[i].dims.y;
-		max_y = l->object_arr[i].pos.y;
-
-		/* check if pos is within obj bounds */
-		if ( (pos->x >= min_x && pos->x <= max_x) &&
-		     (pos->y >= min_y && pos->y <= max_y) ) {
-                        /* is colliding */
-			return_type = l->object_arr[i].type;
-			brk = 1;
-		}
-
-		/* if projectile out of window bounds */
-		if (is_oob(pos)) {
-                        /* is out of bounds */
-			return_type = 0;
-			brk = 1;
-		}
-		i++;
-	}
-
-	return return_type;
+        int trig = -1;
+	return collide_point( pos, l, &trig );
 }
 
 /*
@@ -115,19 +198,22 @@ Collision method based on the Super Mario 64 Quarter-Step Collision method.
 Given the previous position and the current position, the function checks
 collision at each quarter of the distance. If there is collision at any of the
 steps, return the last step that did not collide. If there is a collision, the
-type of object is also returned for future processing.
+type of object is also returned for future processing. The first trigger volume
+entered at any of the steps before the collision is returned too.
 ---
 struct Position * curr_pos: current position of the projectile
 struct Position * prev_pos: previous position of the projectile
 struct Level * l: level to be passed to the is_collide() function
 unsigned int * type: type of object the projectile collided with, if collision
+int * trig: index in object_arr of the trigger entered, -1 if none
 ---
 Returns unsigned int from 0-4,
-returns unsigned int * type [implicit].
+returns unsigned int * type and int * trig [implicit].
 */
 unsigned int do_step_collision( struct Position * curr_pos,
 				struct Position * prev_pos,
-				struct Level * l, unsigned int * type  )
+				struct Level * l, unsigned int * type,
+				int * trig )
 {
         float step_x = ( curr_pos->x - prev_pos->x ) / 4;
 	float step_y = ( curr_pos->y - prev_pos->y ) / 4;
@@ -141,6 +227,8 @@ unsigned int do_step_collision( struct Position * curr_pos,
 	/* iterate throug the four steps */
 	int i = 1;
 	unsigned int brk = 0;
+	int t;
+	*trig = -1;
 	
 	while ( i < 5 && !brk ) {
                 /* increment step */
@@ -148,12 +236,17 @@ unsigned int do_step_collision( struct Position * curr_pos,
 		step_pos.y += step_y;
 
 		/* check for collision */
-		coll_type = is_collide( &step_pos, l );
+		t = -1;
+		coll_type = collide_point( &step_pos, l, &t );
 		if ( coll_type != -1 ) {
                         /* collision has occured */
 			step = i - 1;
 			*type = coll_type;
 			brk = 1;
+		} else if ( t >= 0 && *trig < 0 &&
+			    !is_in_object( prev_pos, &l->object_arr[t] ) ) {
+                        /* only entering a trigger counts */
+			*trig = t;
 		}
 
 		i++;
@@ -161,6 +254,657 @@ unsigned int do_step_collision( struct Position * curr_pos,
 	return step;
 }
 
+/*
+static unsigned int sweep_object()
+---
+Sweeps a segment against the bounds of an object (edges included) using the
+slab method: the segment is clipped against the x bounds and then the y
+bounds, and it hits if anything is left. Objects the segment's bounds do not
+touch are rejected straight away.
+---
+struct Position * p: start of the segment
+struct Position * d: direction of the segment (end - start)
+struct Position * inv: 1/d for each component (only used if it is not 0)
+struct Position * lo, * hi: bounds of the segment
+struct Object * o: object to sweep against
+float * toi: fraction of the segment travelled before the hit
+struct Position * normal: normal of the side hit
+---
+Returns an unsigned int, 1 if hit, 0 if not,
+returns float * toi and struct Position * normal [implicit].
+*/
+static unsigned int sweep_object( struct Position * p, struct Position * d,
+				  struct Position * inv, struct Position * lo,
+				  struct Position * hi, struct Object * o,
+				  float * toi, struct Position * normal )
+{
+	float mins[2] = { o->pos.x, o->pos.y - o->dims.y };
+	float maxs[2] = { o->pos.x + o->dims.x, o->pos.y };
+
+	/* bounds do not overlap, so the segment cannot hit */
+	if ( hi->x < mins[0] || lo->x > maxs[0] ||
+	     hi->y < mins[1] || lo->y > maxs[1] )
+		return 0;
+	
+	float start[2] = { p->x, p->y };
+	float dir[2] = { d->x, d->y };
+	float rcp[2] = { inv->x, inv->y };
+	float t_enter = 0;
+	float t_exit = 1;
+	int axis = -1; /* axis the segment entered through */
+	float side = 0;
+	float t0, t1, s;
+
+	for ( int a = 0; a < 2; a++ ) {
+		/* parallel, so the bounds check above already covers it */
+                if ( dir[a] == 0 )
+			continue;
+		
+		t0 = ( mins[a] - start[a] ) * rcp[a];
+		t1 = ( maxs[a] - start[a] ) * rcp[a];
+		s = -1; /* entering through the min side */
+		if ( t0 > t1 ) {
+			float tmp = t0; t0 = t1; t1 = tmp;
+			s = 1;
+		}
+		if ( t0 > t_enter ) {
+			t_enter = t0;
+			axis = a;
+			side = s;
+		}
+		if ( t1 < t_exit )
+			t_exit = t1;
+		if ( t_enter > t_exit )
+			return 0;
+	}
+
+	*toi = t_enter;
+	initialize_position( normal, 0, 0 );
+	if ( axis == 0 )
+		normal->x = side;
+	else if ( axis == 1 )
+		normal->y = side;
+	return 1;
+}
+
+/*
+static void sweep_candidate()
+---
+Sweeps a segment against one object, keeping it if it is hit before the best
+hit so far. Ties go to the first object in object_arr. Trigger volumes are
+kept apart from the objects hit, and only count if the segment enters them
+(starting inside one doesn't).
+---
+struct Position * seg: start, direction, 1/direction, and lower and upper
+                       bounds of the segment (see sweep_object())
+struct Level * l: level with the object
+unsigned int i: index of the object in object_arr
+float * best: toi of the best hit so far
+unsigned int * best_i: index of the object of the best hit so far
+struct Position * normal: normal of the best hit so far
+float * trig_toi: toi of the first trigger entered so far
+int * trig: index of the first trigger entered so far, -1 if none
+---
+Returns the best hit and trigger [implicit].
+*/
+static void sweep_candidate( struct Position seg[5], struct Level * l,
+			     unsigned int i, float * best,
+			     unsigned int * best_i, struct Position * normal,
+			     float * trig_toi, int * trig )
+{
+	float toi;
+	struct Position n;
+	
+	if ( sweep_object( &seg[0], &seg[1], &seg[2], &seg[3], &seg[4],
+			   &l->object_arr[i], &toi, &n ) ) {
+                if ( l->object_arr[i].type >= OBJ_TRIGGER ) {
+                        if ( toi > 0 && ( *trig < 0 || toi < *trig_toi ||
+					  ( toi == *trig_toi &&
+					    (int)i < *trig ) ) ) {
+                                *trig_toi = toi;
+				*trig = i;
+			}
+		} else if ( toi < *best || ( toi == *best && i < *best_i ) ) {
+                        *best = toi;
+			*best_i = i;
+			*normal = n;
+		}
+	}
+}
+
+/*
+static unsigned int sweep_oob()
+---
+Finds where a segment leaves the bounds of the level, if it does before a
+given fraction of the segment. Being on the edge counts as out of bounds, same
+as is_oob().
+---
+struct Position * p: start of the segment
+struct Position * d: direction of the segment (end - start)
+struct Level * l: level the segment is in
+float * toi: fraction of the segment to check up to, changed to where the
+             segment leaves the level if it does
+struct Position * normal: normal of the level edge, if it leaves
+---
+Returns an unsigned int, 1 if the segment leaves the level, 0 if not,
+returns float * toi and struct Position * normal [implicit].
+*/
+static unsigned int sweep_oob( struct Position * p, struct Position * d,
+			       struct Level * l, float * toi,
+			       struct Position * normal )
+{
+	float start[2] = { p->x, p->y };
+	float dir[2] = { d->x, d->y };
+	float maxs[2] = { l->width, l->height };
+	unsigned int hit = 0;
+	float t;
+
+	/* already out of bounds */
+	if ( is_oob( p, l ) ) {
+                *toi = 0;
+		initialize_position( normal, 0, 0 );
+		return 1;
+	}
+
+	for ( int a = 0; a < 2; a++ ) {
+                if ( dir[a] < 0 )
+			t = ( 0 - start[a] ) / dir[a];
+		else if ( dir[a] > 0 )
+			t = ( maxs[a] - start[a] ) / dir[a];
+		else
+			continue;
+
+		if ( t <= *toi ) {
+                        *toi = t;
+			hit = 1;
+			initialize_position( normal, 0, 0 );
+			if ( a == 0 )
+				normal->x = dir[a] < 0 ? 1 : -1;
+			else
+				normal->y = dir[a] < 0 ? 1 : -1;
+		}
+	}
+	return hit;
+}
+
+/*
+float do_swept_collision()
+---
+Exact continuous collision. Sweeps the segment from the previous position to
+the current position against the bounds of every object it passes near, and
+against the bounds of the level. Returns the exact fraction of the segment
+travelled before the first hit, along with the normal of the surface hit.
+If two objects are hit at the same time, the first in object_arr is used, same
+as is_collide().
+---
+struct Position * curr_pos: current position of the projectile
+struct Position * prev_pos: previous position of the projectile
+struct Level * l: level with the objects to test against
+unsigned int * type: type of object the projectile collided with, if collision
+struct Position * normal: normal of the surface hit, if collision. (0,0) if
+                          prev_pos is already inside an object
+int * trig: index in object_arr of the first trigger entered before the hit,
+	    -1 if none
+---
+Returns float from 0-1 (1 if no collision),
+returns unsigned int * type, struct Position * normal and int * trig
+[implicit].
+*/
+float do_swept_collision( struct Position * curr_pos,
+			  struct Position * prev_pos,
+			  struct Level * l, unsigned int * type,
+			  struct Position * normal, int * trig )
+{
+	/* start, direction, 1/direction and bounds of the segment */
+	struct Position seg[5];
+	struct Position * d = &seg[1];
+	seg[0] = *prev_pos;
+	initialize_position( d, curr_pos->x - prev_pos->x,
+			     curr_pos->y - prev_pos->y );
+	initialize_position( &seg[2], ( d->x != 0 ) ? 1 / d->x : 0,
+			     ( d->y != 0 ) ? 1 / d->y : 0 );
+	initialize_position( &seg[3], fminf( prev_pos->x, curr_pos->x ),
+			     fminf( prev_pos->y, curr_pos->y ) );
+	initialize_position( &seg[4], fmaxf( prev_pos->x, curr_pos->x ),
+			     fmaxf( prev_pos->y, curr_pos->y ) );
+	
+	float best = 2; /* greater than any real toi */
+	unsigned int best_i = 0;
+	float trig_toi = 2;
+	struct Position n;
+	*trig = -1;
+
+	/* no grid, so sweep against every object */
+	if ( l->grid.start == NULL ) {
+                for ( unsigned int i = 0; i < l->index; i++ )
+			sweep_candidate( seg, l, i, &best, &best_i, normal,
+					 &trig_toi, trig );
+	} else {
+		/* figure out the range of cells the segment passes through */
+		float bounds[4] = { seg[3].x, seg[3].y, seg[4].x, seg[4].y };
+		unsigned int cells[4];
+		unsigned int max[2] = { l->grid.w - 1, l->grid.h - 1 };
+		for ( int i = 0; i < 4; i++ ) {
+                        float c = floorf( bounds[i] / CELL_SZ );
+			if ( c < 0 )
+				c = 0;
+			if ( c > max[i % 2] )
+				c = max[i % 2];
+			cells[i] = c;
+		}
+
+		/* sweep against the objects in each of those cells */
+		unsigned int cell;
+		for ( unsigned int cy = cells[1]; cy <= cells[3]; cy++ ) {
+			for ( unsigned int cx = cells[0]; cx <= cells[2]; cx++ ) {
+                                cell = cy * l->grid.w + cx;
+				for ( unsigned int j = l->grid.start[cell];
+				      j < l->grid.start[cell + 1]; j++ )
+					sweep_candidate( seg, l,
+							 l->grid.items[j],
+							 &best, &best_i,
+							 normal, &trig_toi,
+							 trig );
+			}
+		}
+	}
+	if ( best <= 1 )
+		*type = l->object_arr[best_i].type;
+	else
+		best = 1;
+
+	/* leaving the level counts as hitting a type 0 object */
+	if ( l->index > 0 ) {
+		if ( sweep_oob( prev_pos, d, l, &best, &n ) ) {
+			*type = 0;
+			*normal = n;
+		}
+	}
+
+	/* triggers past the hit were never reached */
+	if ( *trig >= 0 && trig_toi > best )
+		*trig = -1;
+
+	return best;
+}
+
+/* how far back from a surface a projectile is left after a swept hit, and how
+   far it has to move to not count as stuck (both in px) */
+#define SWEPT_BACKOFF (0.01)
+#define SWEPT_MIN_MOVE (0.5)
+
+/*
+unsigned int do_collision()
+---
+Checks collision between the previous and current position of a projectile
+using the collision mode picked by COLL_MODE, then moves the current position
+back so it is no longer inside anything. Trigger volumes are not collided with,
+but the first one entered on the way is returned, so it can be recorded as an
+event without checking again.
+---
+struct Position * curr_pos: current position of the projectile, moved back if
+                            there is a collision
+struct Position * prev_pos: previous position of the projectile
+struct Level * l: level with the objects to test against
+unsigned int * type: type of object the projectile collided with, if collision
+int * trig: index in object_arr of the trigger entered, -1 if none
+---
+Returns unsigned int, 1 if the projectile moved, 0 if it could not move at all,
+returns unsigned int * type and int * trig [implicit].
+*/
+unsigned int do_collision( struct Position * curr_pos,
+			   struct Position * prev_pos,
+			   struct Level * l, unsigned int * type, int * trig )
+{
+	float dx = curr_pos->x - prev_pos->x;
+	float dy = curr_pos->y - prev_pos->y;
+	
+#if COLL_MODE != COLL_QUARTER
+	struct Position normal;
+	float len = sqrtf( dx*dx + dy*dy );
+	float toi = do_swept_collision( curr_pos, prev_pos, l, type, &normal,
+					trig );
+	if ( toi < 1 ) {
+                /* stop just short of the surface hit */
+		toi -= ( len > 0 ) ? SWEPT_BACKOFF / len : toi;
+		if ( toi < 0 )
+			toi = 0;
+		curr_pos->x = prev_pos->x + dx * toi;
+		curr_pos->y = prev_pos->y + dy * toi;
+	}
+	return ( toi * len >= SWEPT_MIN_MOVE || toi == 1 );
+#else
+	unsigned int step = do_step_collision( curr_pos, prev_pos, l, type,
+					       trig );
+	
+	/* fix position to the last step that did not collide */
+	curr_pos->x = prev_pos->x + ( dx / 4 ) * step;
+	curr_pos->y = prev_pos->y + ( dy / 4 ) * step;
+	return ( step > 0 );
+#endif
+}
+
+/*
+static int solve()
+---
+Finds the roots of a*t^2 + b*t + c = 0 (or b*t + c = 0 if a is 0) that are
+between t0 and horizon
+---
+double a, b, c: coefficients of the equation
+double t0, horizon: range the roots have to be in
+double * out: array to store the roots in (must fit 2)
+---
+Returns an int, no. of roots found,
+returns double * out [implicit].
+*/
+static int solve( double a, double b, double c, double t0, double horizon,
+		  double * out )
+{
+	double roots[2];
+	int n = 0;
+	int found = 0;
+	
+        if ( a == 0 ) {
+                if ( b != 0 )
+			roots[n++] = -c / b;
+	} else {
+                double disc = b*b - 4*a*c;
+		if ( disc >= 0 ) {
+                        disc = sqrt( disc );
+			roots[n++] = ( -b - disc ) / ( 2*a );
+			roots[n++] = ( -b + disc ) / ( 2*a );
+		}
+	}
+
+	for ( int i = 0; i < n; i++ ) {
+                if ( roots[i] > t0 && roots[i] < horizon )
+			out[found++] = roots[i];
+	}
+	return found;
+}
+
+/*
+static double box_entry()
+---
+Finds the first time along an arc (x = sx + ax*t, y = sy + by*t + cy*t^2) that
+the arc is inside a box, or outside of it. Every time the arc crosses an edge
+of the box is solved for, and the gaps between those times are checked in
+order.
+---
+double m[5]: sx, ax, sy, by, cy of the arc
+double mins[2], maxs[2]: bounds of the box
+unsigned int outside: 1 to find when the arc leaves the box instead (being on
+                      an edge counts as outside)
+unsigned int skip_start: 1 to ignore the arc already being inside at t0
+double t0, horizon: range of time to look in
+---
+Returns a double, time found, -1 if there is none
+*/
+static double box_entry( double m[5], double mins[2], double maxs[2],
+			 unsigned int outside, unsigned int skip_start,
+			 double t0, double horizon )
+{
+	double crit[10];
+	int n = 0;
+	double tmp, mid, x, y;
+	unsigned int in;
+
+	/* times the arc crosses each edge of the box */
+	crit[n++] = t0;
+	n += solve( 0, m[1], m[0] - mins[0], t0, horizon, &crit[n] );
+	n += solve( 0, m[1], m[0] - maxs[0], t0, horizon, &crit[n] );
+	n += solve( m[4], m[3], m[2] - mins[1], t0, horizon, &crit[n] );
+	n += solve( m[4], m[3], m[2] - maxs[1], t0, horizon, &crit[n] );
+	crit[n++] = horizon;
+
+	/* sort crossing times */
+	for ( int i = 1; i < n; i++ ) {
+                for ( int j = i; j > 0 && crit[j] < crit[j-1]; j-- ) {
+                        tmp = crit[j]; crit[j] = crit[j-1]; crit[j-1] = tmp;
+		}
+	}
+
+	/* check the middle of each gap between crossings */
+	for ( int i = 0; i < n - 1; i++ ) {
+                if ( crit[i+1] <= crit[i] )
+			continue;
+		mid = ( crit[i] + crit[i+1] ) / 2;
+		x = m[0] + m[1]*mid;
+		y = m[2] + m[3]*mid + m[4]*mid*mid;
+		if ( outside )
+			in = ( x <= mins[0] || x >= maxs[0] ||
+			       y <= mins[1] || y >= maxs[1] );
+		else
+			in = ( x >= mins[0] && x <= maxs[0] &&
+			       y >= mins[1] && y <= maxs[1] );
+		
+		if ( in && !( skip_start && crit[i] == t0 ) )
+			return crit[i];
+	}
+	return -1;
+}
+
+/*
+float next_event()
+---
+Solves for the next time a projectile's arc enters an object, leaves the
+level or (optionally) enters a trigger volume, starting from a given time. As
+the arc is a closed-form SUVAT expression (see calculate_position()), no
+stepping is needed, so collision work is only done once per event instead of
+once per frame.
+The time returned is moved slightly before a hit so the projectile is left
+just outside the object, or slightly after entering a trigger so it is left
+just inside.
+---
+struct Position * s_pos: starting position of the arc
+struct Position * v: velocity of the arc
+struct Level * l: level with the objects, wind and gravity
+float t0: time to start looking from
+unsigned int with_triggers: whether entering a trigger counts as an event
+unsigned int * type: type of object hit, 0 if out of bounds, EVENT_TRIGGER if
+                     a trigger is entered, EVENT_NONE if nothing happens
+                     before EVENT_HORIZON
+---
+Returns a float, time of the event,
+returns unsigned int * type [implicit].
+*/
+float next_event( struct Position * s_pos, struct Position * v,
+		  struct Level * l, float t0, unsigned int with_triggers,
+		  unsigned int * type )
+{
+	/* same arc as calculate_position() */
+	double m[5] = { s_pos->x, v->x + l->wind.x + l->gravity.x,
+			s_pos->y, v->y - l->wind.y, l->gravity.y / 2 };
+	double best = EVENT_HORIZON;
+	double t;
+	*type = EVENT_NONE;
+
+	/* objects, earliest wins and ties go to the first in object_arr */
+	for ( unsigned int i = 0; i < l->index; i++ ) {
+                struct Object * o = &l->object_arr[i];
+		if ( o->type >= OBJ_TRIGGER )
+			continue;
+		double mins[2] = { o->pos.x, o->pos.y - o->dims.y };
+		double maxs[2] = { o->pos.x + o->dims.x, o->pos.y };
+		t = box_entry( m, mins, maxs, 0, 0, t0, best );
+		if ( t >= 0 && t < best ) {
+                        best = t;
+			*type = o->type;
+		}
+	}
+
+	/* out of bounds, which wins ties like in is_collide() */
+	if ( l->index > 0 ) {
+		double mins[2] = { 0, 0 };
+		double maxs[2] = { l->width, l->height };
+		t = box_entry( m, mins, maxs, 1, 0, t0, best );
+		if ( t >= 0 && t <= best ) {
+                        best = t;
+			*type = 0;
+		}
+	}
+
+	/* triggers, which lose ties and are ignored if the arc starts inside
+	   them */
+	for ( unsigned int i = 0; with_triggers && i < l->index; i++ ) {
+                struct Object * o = &l->object_arr[i];
+		if ( o->type < OBJ_TRIGGER )
+			continue;
+		double mins[2] = { o->pos.x, o->pos.y - o->dims.y };
+		double maxs[2] = { o->pos.x + o->dims.x, o->pos.y };
+		t = box_entry( m, mins, maxs, 0, 1, t0, best );
+		if ( t >= 0 && t < best ) {
+                        best = t;
+			*type = EVENT_TRIGGER;
+		}
+	}
+
+	/* leave the projectile just outside what it hit */
+	if ( *type == EVENT_TRIGGER )
+		best += EVENT_BACKOFF;
+	else if ( *type != EVENT_NONE )
+		best -= EVENT_BACKOFF;
+	if ( best < t0 )
+		best = t0;
+	
+	return best;
+}
+
+/*
+unsigned int calculate_path()
+---
+Calculates the aim preview of a throw towards the mouse, up to the first
+collision. Rebounds and jumps are ignored.
+---
+struct Position * mouse: position the throw is aimed at
+struct Level * l: level the throw is in
+struct Position * pts: array to store the path in. pts[0] is the starting
+                       position, and pts[i+1] is the position at
+                       i * TIME_INC
+unsigned int max: size of pts, the path is cut short if it does not fit
+---
+Returns unsigned int, no. of points in the path,
+returns struct Position * pts [implicit].
+*/
+unsigned int calculate_path( struct Position * mouse, struct Level * l,
+			     struct Position * pts, unsigned int max )
+{
+	//defensive copy of start position
+	struct Position pos;
+        initialize_position( &pos, l->start_pos.x, l->start_pos.y );
+	
+        if ( mouse->x < (l->start_pos.x+13) ) {
+		pos.x -= 50;
+		pos.y -=50;
+	} else {
+                pos.x += 50;
+		pos.y -=50;
+	}
+
+	//calculate component velocity from mouse pos
+	struct Position velocity;
+	get_velocity_from_mouse( &velocity, &pos, mouse );
+
+	unsigned int index = 0;
+	float time = 0;
+	unsigned int type = 0;//ignored for this, rebounds and jumps ignored
+	
+	//starting position
+	struct Position s_pos;
+	initialize_position( &s_pos, pos.x, pos.y );
+	pts[index++] = s_pos;
+
+#if COLL_MODE == COLL_EVENT
+	//the whole path is known up to the first hit
+	float t_hit = next_event( &s_pos, &velocity, l, 0, 0, &type );
+#endif
+
+	unsigned int last_coll = 1;
+        while ( last_coll > 0 && index < max ) {
+#if COLL_MODE == COLL_EVENT
+		//stop at the first hit, no collision work until then
+		if ( time >= t_hit ) {
+                        time = t_hit;
+			last_coll = 0;
+		}
+		calculate_position( &velocity, &pos, &s_pos, l, time );
+#else
+		int trig;//ignored, the preview goes through triggers
+		
+                //calculate new position and increment time
+		calculate_position( &velocity, &pos, &s_pos, l, time );
+		//stop the throw from going inside a wall
+		last_coll = do_collision( &pos, &pts[index - 1], l, &type,
+					  &trig );
+#endif
+		
+		time = time + TIME_INC;
+		pts[index++] = pos;
+	}
+	return index;
+}
+
+/*
+void snap_aim()
+---
+Snaps a mouse position down to the PATH_QUANT grid that throws are aimed on
+---
+struct Position * mouse: position to snap
+---
+Returns the snapped struct Position * mouse [implicit].
+*/
+void snap_aim( struct Position * mouse )
+{
+        mouse->x = floorf( mouse->x / PATH_QUANT ) * PATH_QUANT;
+	mouse->y = floorf( mouse->y / PATH_QUANT ) * PATH_QUANT;
+}
+
+/*
+struct Path * get_path()
+---
+Gets the aim preview of a throw towards the mouse from the level's path
+cache. The mouse position is snapped to a PATH_QUANT grid (see snap_aim()),
+so small mouse movements reuse a cached path. Throws are snapped the same way
+when fired, so the preview is always the path the arrow takes. If the path is
+not cached, it is calculated and replaces the least recently used path.
+---
+struct Position * mouse: position the throw is aimed at
+struct Level * l: level the throw is in
+---
+Returns the path, NULL if the level has no path cache
+*/
+struct Path * get_path( struct Position * mouse, struct Level * l )
+{
+	struct Path_cache * pc = &l->paths;
+	if ( pc->paths == NULL )
+		return NULL;
+	
+	int qx = floorf( mouse->x / PATH_QUANT );
+	int qy = floorf( mouse->y / PATH_QUANT );
+	struct Path * lru = &pc->paths[0];
+	
+	pc->clock++;
+	for ( int i = 0; i < PATH_CACHE_SZ; i++ ) {
+                struct Path * p = &pc->paths[i];
+		if ( p->n > 0 && p->qx == qx && p->qy == qy ) {
+			/* cached */
+                        p->last_used = pc->clock;
+			return p;
+		}
+		if ( p->last_used < lru->last_used )
+			lru = p;
+	}
+
+	/* not cached, so calculate it in place of the least recently used */
+	struct Position snapped = *mouse;
+	snap_aim( &snapped );
+	lru->qx = qx;
+	lru->qy = qy;
+	lru->last_used = pc->clock;
+	lru->n = calculate_path( &snapped, l, lru->pts, PATH_MAX_PTS );
+	return lru;
+}
+
 /*
 void calculate_position()
 ---
@@ -207,24 +951,234 @@ void calc_arc_from_comp( struct Position * p, float * mag, float * angle,
 		*angle *= 180/M_PI;
 }
 
+/*
+static void advance_range()
+---
+Advances projectiles from a given index to the last one in flight one at a
+time. The arc is written out in the same order as calculate_position() so the
+result is rounded the same way.
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level the projectiles are in
+unsigned int start: first index to advance
+*/
+static void advance_range( struct Proj_arr * p, struct Level * l,
+			   unsigned int start )
+{
+        for ( unsigned int i = start; i < p->count; i++ ) {
+                float t = p->time[i];
+		p->x[i] = p->sx[i] + ( p->vx[i] + l->wind.x + l->gravity.x ) * t;
+		p->y[i] = p->sy[i] + ( p->vy[i] - l->wind.y ) * t +
+			  (( l->gravity.y ) * t * t) /2;
+	}
+}
+
+/*
+void advance_projectiles_scalar()
+---
+Same as advance_projectiles() but one projectile at a time.
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level the projectiles are in, stores wind and gravity
+---
+Returns new values for the x and y arrays of p [implicit].
+*/
+void advance_projectiles_scalar( struct Proj_arr * p, struct Level * l )
+{
+        advance_range( p, l, 0 );
+}
+
+/*
+void advance_projectiles()
+---
+Moves every projectile in a Proj_arr to its position at its current time,
+using the same arc as calculate_position(). Uses SSE to advance 4 projectiles
+at a time where available, otherwise falls back to
+advance_projectiles_scalar(). Both give exactly the same positions.
+
+Only the projectiles in flight are advanced, as they are packed at the start
+of the arrays.
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level the projectiles are in, stores wind and gravity
+---
+Returns new values for the x and y arrays of p [implicit].
+*/
+void advance_projectiles( struct Proj_arr * p, struct Level * l )
+{
+        unsigned int i = 0;
+#ifdef __SSE__
+	__m128 wx = _mm_set1_ps( l->wind.x );
+	__m128 wy = _mm_set1_ps( l->wind.y );
+	__m128 gx = _mm_set1_ps( l->gravity.x );
+	__m128 gy = _mm_set1_ps( l->gravity.y );
+	__m128 two = _mm_set1_ps( 2 );
+
+	for ( ; i + 4 <= p->count; i += 4 ) {
+                __m128 t = _mm_loadu_ps( p->time + i );
+		
+		/* sx + ((vx + wind.x) + grav.x) * t */
+		__m128 ax = _mm_add_ps( _mm_add_ps( _mm_loadu_ps( p->vx + i ),
+						    wx ), gx );
+		__m128 x = _mm_add_ps( _mm_loadu_ps( p->sx + i ),
+				       _mm_mul_ps( ax, t ) );
+
+		/* sy + (vy - wind.y) * t + ((grav.y * t) * t) / 2 */
+		__m128 vy = _mm_sub_ps( _mm_loadu_ps( p->vy + i ), wy );
+		__m128 y = _mm_add_ps( _mm_loadu_ps( p->sy + i ),
+				       _mm_mul_ps( vy, t ) );
+		y = _mm_add_ps( y, _mm_div_ps( _mm_mul_ps( _mm_mul_ps( gy, t ),
+							   t ), two ) );
+		
+		_mm_storeu_ps( p->x + i, x );
+		_mm_storeu_ps( p->y + i, y );
+	}
+#endif
+	/* whatever is left over (or everything, without SSE) */
+	advance_range( p, l, i );
+}
+
+/*
+static void step_projectile()
+---
+Checks a single projectile for collisions at the position it was advanced to,
+then reacts to whatever it hit and moves its time on. Entering a trigger
+volume on the way is recorded as an event
+---
+struct Proj_arr * p: projectiles to use
+unsigned int i: index of the projectile to step
+struct Level * l: level the projectile is in
+float dt: time to move the projectile on by
+*/
+static void step_projectile( struct Proj_arr * p, unsigned int i,
+			     struct Level * l, float dt )
+{
+	unsigned int type = 0;
+	int trig = -1;
+	struct Position pos, p_pos;
+	initialize_position( &pos, p->x[i], p->y[i] );
+	initialize_position( &p_pos, p->px[i], p->py[i] );
+#if COLL_MODE == COLL_EVENT
+	//solve for the next event if it is not known yet
+	if ( p->t_event[i] < 0 ) {
+                struct Position s_pos, vel;
+		initialize_position( &s_pos, p->sx[i], p->sy[i] );
+		initialize_position( &vel, p->vx[i], p->vy[i] );
+		p->t_event[i] = next_event( &s_pos, &vel, l, p->time[i], 1,
+					    &p->e_type[i] );
+	}
+	
+	if ( p->time[i] < p->t_event[i] ) {
+		//no collision work needed until the event
+		type = EVENT_NONE;
+	} else {
+                //move to exactly where the event happens
+                struct Position s_pos, vel;
+		initialize_position( &s_pos, p->sx[i], p->sy[i] );
+		initialize_position( &vel, p->vx[i], p->vy[i] );
+		p->time[i] = p->t_event[i];
+		calculate_position( &vel, &pos, &s_pos, l, p->time[i] );
+		type = p->e_type[i];
+		p->t_event[i] = -1;
+
+		//the event only says a trigger was entered, find which
+		if ( type == EVENT_TRIGGER )
+			collide_point( &pos, l, &trig );
+
+		//anything other than a rebound or jump stops the throw
+		if ( type != EVENT_NONE && type != EVENT_TRIGGER &&
+		     ( type < 1 || type > 4 ) )
+			p->p_coll[i] = 0;
+	}
+#else
+	//stop the throw from going inside a wall
+	p->p_coll[i] = do_collision( &pos, &p_pos, l, &type, &trig );
+#endif
+	p->x[i] = pos.x;
+	p->y[i] = pos.y;
+
+	if ( trig >= 0 )
+		add_trigger_event( p, i, trig, l->object_arr[trig].type );
+
+	//check type of collision
+	switch (type) {
+	case 1:
+		//rebound
+		do_rebound( p, i );
+		break;
+	case 2:
+		//jump pad
+		do_bounce( p, i, -250 );
+		break;
+	case 3:
+		//jump pad but smaller
+		do_bounce( p, i, -100 );
+		break;
+	case 4:
+		//jump pad mid
+		do_bounce( p, i, -200 );
+		break;
+	default:
+		p->time[i] = p->time[i] + dt;
+		break;
+	}
+}
+
+/*
+void simulate_step()
+---
+Advances every projectile in flight by one fixed tick: moves it along its arc,
+checks for collisions, rebounds or bounces it and moves its time on.
+Projectiles that could not move at all last tick are removed, which moves
+others to a new index (their handles stay valid). Every trigger volume entered
+during the tick is left in the events of p. Nothing is drawn, so this can run
+without a display.
+---
+struct Level * l: level the projectiles are in
+struct Proj_arr * p: projectiles to step
+float dt: time to move each projectile on by (normally TIME_INC)
+*/
+void simulate_step( struct Level * l, struct Proj_arr * p, float dt )
+{
+        p->n_events = 0;
+        for ( unsigned int i = 0; i < p->count; ) {
+		if ( !(p->p_coll[i] > 0) ) {
+                        /* the last projectile now sits at i, look again */
+                        remove_from_proj_arr( p, i );
+			continue;
+		}
+		/* remember where each projectile was before this tick */
+		p->px[i] = p->x[i];
+		p->py[i] = p->y[i];
+		i++;
+	}
+
+	advance_projectiles( p, l );
+	
+        for ( unsigned int i = 0; i < p->count; i++ )
+		step_projectile( p, i, l, dt );
+}
+
 /*
 void do_rebound()
 ---
 Setup a given projectile to rebound from a wall
 ---
-struct Projectile * p: projectile to rebound
+struct Proj_arr * p: projectiles to use
+unsigned int i: index of the projectile to rebound
 */
-void do_rebound( struct Projectile * p )
+void do_rebound( struct Proj_arr * p, unsigned int i )
 {
-	initialize_position(&p->s_pos, p->pos.x, p->pos.y);
-	initialize_position(&p->p_pos, p->pos.x, p->pos.y);
+	p->sx[i] = p->px[i] = p->x[i];
+	p->sy[i] = p->py[i] = p->y[i];
 	
 	/* rebound with less velocity */
-	p->vel.x = -(p->vel.x) / 1.5;
+	p->vx[i] = -(p->vx[i]) / 1.5;
 
 	/* restart as if new throw */
-	p->time = 0;
-	p->p_coll = 4;
+	p->time[i] = 0;
+	p->p_coll[i] = 1;
+	p->t_event[i] = -1;
 }
 
 /*
@@ -232,18 +1186,20 @@ void do_bounce()
 ---
 Setup a given projectile to bounce up from a jump pad with a given velocity
 ---
-struct Projectile * p: projectile to bounce
+struct Proj_arr * p: projectiles to use
+unsigned int i: index of the projectile to bounce
 int b_vel: velocity of the bounce
 */
-void do_bounce( struct Projectile * p, int b_vel )
+void do_bounce( struct Proj_arr * p, unsigned int i, int b_vel )
 {
-	initialize_position(&p->s_pos, p->pos.x, p->pos.y);
-	initialize_position(&p->p_pos, p->pos.x, p->pos.y);
+	p->sx[i] = p->px[i] = p->x[i];
+	p->sy[i] = p->py[i] = p->y[i];
 	
 	/* bounce with given vel */
-	p->vel.y = b_vel;
+	p->vy[i] = b_vel;
 
 	/* restart as if new throw */
-	p->time = 0;
-	p->p_coll = 4;
+	p->time[i] = 0;
+	p->p_coll[i] = 1;
+	p->t_event[i] = -1;
 }
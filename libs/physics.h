@@ -12,9 +12,28 @@ collisions, etc.
 
 #include "structures.h"
 
-#define TM_SZ (300) /* 20x15 tilemap size, equal to window width/height / 32 */
 #define THROW_FACTOR (2) /* how much to divide the mouse velocity by */
 
+#define TARGET_SZ (50) /* width and height of the target's trigger, if the
+			  level file doesn't give one */
+#define TIME_INC (0.0875) /* time a projectile moves forward each frame */
+
+/* collision modes, pick one with -DCOLL_MODE=... */
+#define COLL_QUARTER (0) /* sample 4 points along each step */
+#define COLL_SWEPT (1)   /* exact swept segment vs object test */
+#define COLL_EVENT (2)   /* solve for each hit ahead of time (see
+                            next_event()), other callers use COLL_SWEPT */
+
+/* event types from next_event(), along with object types */
+#define EVENT_NONE ((unsigned int)-1)   /* nothing before EVENT_HORIZON */
+#define EVENT_TRIGGER ((unsigned int)-2) /* entered a trigger volume */
+#define EVENT_HORIZON (1000) /* how far ahead to look for events (time) */
+#define EVENT_BACKOFF (0.001) /* how far to stop before a hit (time) */
+
+#ifndef COLL_MODE
+#define COLL_MODE (COLL_QUARTER)
+#endif
+
 /*
 void get_velocity_from_mouse()
 ---
@@ -29,6 +48,28 @@ struct Position * mouse: current xy pos of the mouse
 void get_velocity_from_mouse( struct Position *, struct Position *,
 			      struct Position * );
 
+/*
+unsigned int is_collide()
+---
+Checks if a projectile at position (pos) collides with any of the objects in
+the level. If the level has a grid, only the objects in the cell containing
+pos are checked, otherwise this is done by iterating through all the objects
+on object_arr. Either way the first object in object_arr that pos is within
+is the one used. Trigger volumes are passed through.
+Also checks if the projectile is out of bounds of the level
+---
+struct Position * pos: position the projectile is at ( stored as float )
+struct Level * l: level the projectile is in, stores the object_arr
+                  of the level
+---
+Returns an unsigned int, -1 if no collision, type of object if collision,
+0 is out of bounds.
+
+This is because objects can have type 0, which leads to confusion when parsing
+the result.
+*/
+unsigned int is_collide( struct Position *, struct Level * );
+
 /*
 unsigned int do_step_collide()
 ---
@@ -36,18 +77,137 @@ Collision method based on the Super Mario 64 Quarter-Step Collision method.
 Given the previous position and the current position, the function checks
 collision at each quarter of the distance. If there is collision at any of the
 steps, return the last step that did not collide. If there is a collision, the
-type of object is also returned for future processing.
+type of object is also returned for future processing. The first trigger volume
+entered at any of the steps before the collision is returned too.
 ---
 struct Position * curr_pos: current position of the projectile
 struct Position * prev_pos: previous position of the projectile
 struct Level * l: level to be passed to the is_collide() function
 unsigned int * type: type of object the projectile collided with, if collision
+int * trig: index in object_arr of the trigger entered, -1 if none
 ---
 Returns unsigned int from 0-4,
-returns unsigned int * type [implicit].
+returns unsigned int * type and int * trig [implicit].
 */
 unsigned int do_step_collision( struct Position *, struct Position *,
-				struct Level *, unsigned int * );
+				struct Level *, unsigned int *, int * );
+
+/*
+float do_swept_collision()
+---
+Exact continuous collision. Sweeps the segment from the previous position to
+the current position against the bounds of every object it passes near, and
+against the bounds of the level. Returns the exact fraction of the segment
+travelled before the first hit, along with the normal of the surface hit.
+---
+struct Position * curr_pos: current position of the projectile
+struct Position * prev_pos: previous position of the projectile
+struct Level * l: level with the objects to test against
+unsigned int * type: type of object the projectile collided with, if collision
+struct Position * normal: normal of the surface hit, if collision. (0,0) if
+                          prev_pos is already inside an object
+int * trig: index in object_arr of the first trigger entered before the hit,
+	    -1 if none
+---
+Returns float from 0-1 (1 if no collision),
+returns unsigned int * type, struct Position * normal and int * trig
+[implicit].
+*/
+float do_swept_collision( struct Position *, struct Position *,
+			  struct Level *, unsigned int *, struct Position *,
+			  int * );
+
+/*
+unsigned int do_collision()
+---
+Checks collision between the previous and current position of a projectile
+using the collision mode picked by COLL_MODE, then moves the current position
+back so it is no longer inside anything. Trigger volumes are not collided with,
+but the first one entered on the way is returned, so it can be recorded as an
+event without checking again.
+---
+struct Position * curr_pos: current position of the projectile, moved back if
+                            there is a collision
+struct Position * prev_pos: previous position of the projectile
+struct Level * l: level with the objects to test against
+unsigned int * type: type of object the projectile collided with, if collision
+int * trig: index in object_arr of the trigger entered, -1 if none
+---
+Returns unsigned int, 1 if the projectile moved, 0 if it could not move at all,
+returns unsigned int * type and int * trig [implicit].
+*/
+unsigned int do_collision( struct Position *, struct Position *,
+			   struct Level *, unsigned int *, int * );
+
+/*
+float next_event()
+---
+Solves for the next time a projectile's arc enters an object, leaves the
+level or (optionally) enters a trigger volume, starting from a given time. As
+the arc is a closed-form SUVAT expression (see calculate_position()), no
+stepping is needed, so collision work is only done once per event instead of
+once per frame.
+---
+struct Position * s_pos: starting position of the arc
+struct Position * v: velocity of the arc
+struct Level * l: level with the objects, wind and gravity
+float t0: time to start looking from
+unsigned int with_triggers: whether entering a trigger counts as an event
+unsigned int * type: type of object hit, 0 if out of bounds, EVENT_TRIGGER if
+                     a trigger is entered, EVENT_NONE if nothing happens
+                     before EVENT_HORIZON
+---
+Returns a float, time of the event,
+returns unsigned int * type [implicit].
+*/
+float next_event( struct Position *, struct Position *, struct Level *,
+		  float, unsigned int, unsigned int * );
+
+/*
+unsigned int calculate_path()
+---
+Calculates the aim preview of a throw towards the mouse, up to the first
+collision. Rebounds and jumps are ignored.
+---
+struct Position * mouse: position the throw is aimed at
+struct Level * l: level the throw is in
+struct Position * pts: array to store the path in. pts[0] is the starting
+                       position, and pts[i+1] is the position at
+                       i * TIME_INC
+unsigned int max: size of pts, the path is cut short if it does not fit
+---
+Returns unsigned int, no. of points in the path,
+returns struct Position * pts [implicit].
+*/
+unsigned int calculate_path( struct Position *, struct Level *,
+			     struct Position *, unsigned int );
+
+/*
+void snap_aim()
+---
+Snaps a mouse position down to the PATH_QUANT grid that throws are aimed on
+---
+struct Position * mouse: position to snap
+---
+Returns the snapped struct Position * mouse [implicit].
+*/
+void snap_aim( struct Position * );
+
+/*
+struct Path * get_path()
+---
+Gets the aim preview of a throw towards the mouse from the level's path
+cache. The mouse position is snapped to a PATH_QUANT grid (see snap_aim()),
+so small mouse movements reuse a cached path. Throws are snapped the same way
+when fired, so the preview is always the path the arrow takes. Only
+recalculates the path if it is not in the cache.
+---
+struct Position * mouse: position the throw is aimed at
+struct Level * l: level the throw is in
+---
+Returns the path, NULL if the level has no path cache
+*/
+struct Path * get_path( struct Position *, struct Level * );
 
 /*
 void calculate_position()
@@ -81,22 +241,67 @@ Returns nothing explicitly
 */
 void calc_arc_from_comp( struct Position *, float*, float*, unsigned int );
 
+/*
+void advance_projectiles()
+---
+Moves every projectile in a Proj_arr to its position at its current time,
+using the same arc as calculate_position(). Uses SSE to advance 4 projectiles
+at a time where available, otherwise falls back to
+advance_projectiles_scalar(). Both give exactly the same positions.
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level the projectiles are in, stores wind and gravity
+---
+Returns new values for the x and y arrays of p [implicit].
+*/
+void advance_projectiles( struct Proj_arr *, struct Level * );
+
+/*
+void advance_projectiles_scalar()
+---
+Same as advance_projectiles() but one projectile at a time.
+---
+struct Proj_arr * p: projectiles to advance
+struct Level * l: level the projectiles are in, stores wind and gravity
+---
+Returns new values for the x and y arrays of p [implicit].
+*/
+void advance_projectiles_scalar( struct Proj_arr *, struct Level * );
+
+/*
+void simulate_step()
+---
+Advances every projectile in flight by one fixed tick: moves it along its arc,
+checks for collisions, rebounds or bounces it and moves its time on.
+Projectiles that could not move at all last tick are removed, which moves
+others to a new index (their handles stay valid). Every trigger volume entered
+during the tick is left in the events of p. Nothing is drawn, so this can run
+without a display.
+---
+struct Level * l: level the projectiles are in
+struct Proj_arr * p: projectiles to step
+float dt: time to move each projectile on by (normally TIME_INC)
+*/
+void simulate_step( struct Level *, struct Proj_arr *, float );
+
 /*
 void do_rebound()
 ---
 Setup a given projectile to rebound from a wall
 ---
-struct Projectile * p: projectile to rebound
+struct Proj_arr * p: projectiles to use
+unsigned int i: index of the projectile to rebound
 */
-void do_rebound( struct Projectile * );
+void do_rebound( struct Proj_arr *, unsigned int );
 /*
 void do_bounce()
 ---
 Setup a given projectile to bounce up from a jump pad with a given velocity
 ---
-struct Projectile * p: projectile to bounce
+struct Proj_arr * p: projectiles to use
+unsigned int i: index of the projectile to bounce
 int b_vel: velocity of the bounce
 */
-void do_bounce( struct Projectile *, int );
+void do_bounce( struct Proj_arr *, unsigned int, int );
 
 #endif //PHYSICS_H_
@@ -0,0 +1,267 @@
+/**
+replay.c
+---
+File used to store replays: every input that changes the game, written to a
+file with the tick it was used on, so the game can be played again exactly as
+it went. Each tick only depends on the inputs used on it and the ticks before,
+so playing the same inputs on the same ticks gives the same game, bit for bit.
+Checks of the game's state are written along the way, so a replay that plays
+out differently is caught at the tick it happens on. Needs no allegro.
+
+See game_tick() for where records are made and played back.
+
+Functions that should not be accessed outside of this file are given the
+keyword 'static'.
+*/
+
+#include "replay.h"
+#include "physics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+static void write_u32()
+---
+Writes an unsigned int to a file, little endian
+---
+FILE * f: file to write to
+unsigned int v: value to write
+*/
+static void write_u32( FILE * f, unsigned int v )
+{
+        for ( int i = 0; i < 4; i++ )
+		fputc( ( v >> ( 8 * i ) ) & 0xFF, f );
+}
+
+/*
+static unsigned int read_u32()
+---
+Reads a little endian unsigned int from a file
+---
+FILE * f: file to read from
+unsigned int * v: where to store the value
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int read_u32( FILE * f, unsigned int * v )
+{
+        unsigned char b[4];
+	if ( fread( b, 1, 4, f ) != 4 )
+		return 0;
+	*v = b[0] | b[1] << 8 | b[2] << 16 | (unsigned int)b[3] << 24;
+	return 1;
+}
+
+/*
+static unsigned int hash_bytes()
+---
+Adds bytes to a FNV-1a hash
+---
+unsigned int h: hash so far
+const void * p: bytes to add
+size_t n: no. of bytes
+---
+Returns an unsigned int, the new hash
+*/
+static unsigned int hash_bytes( unsigned int h, const void * p, size_t n )
+{
+        const unsigned char * b = p;
+	for ( size_t i = 0; i < n; i++ ) {
+                h ^= b[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+unsigned int hash_game()
+---
+Hashes everything about a game that its inputs change: the level, score,
+camera, mouse and every projectile, bit for bit
+---
+struct Game * g: game to hash
+---
+Returns an unsigned int, the hash (FNV-1a)
+*/
+unsigned int hash_game( struct Game * g )
+{
+        struct Proj_arr * p = &g->proj;
+	float * fields[] = { p->x, p->y, p->px, p->py, p->sx, p->sy, p->vx,
+			     p->vy, p->time };
+	unsigned int h = 2166136261u;
+
+	h = hash_bytes( h, &g->curr_level, sizeof( g->curr_level ) );
+	h = hash_bytes( h, &g->score, sizeof( g->score ) );
+	h = hash_bytes( h, &g->arrows_fired, sizeof( g->arrows_fired ) );
+	h = hash_bytes( h, &g->screen, sizeof( g->screen ) );
+	h = hash_bytes( h, &g->camera, sizeof( g->camera ) );
+	h = hash_bytes( h, &g->mouse, sizeof( g->mouse ) );
+	h = hash_bytes( h, &p->count, sizeof( p->count ) );
+	for ( unsigned int i = 0; i < sizeof( fields ) / sizeof( *fields );
+	      i++ )
+		h = hash_bytes( h, fields[i], p->count * sizeof( float ) );
+	h = hash_bytes( h, p->id, p->count * sizeof( unsigned int ) );
+	return h;
+}
+
+/*
+unsigned int start_recording()
+---
+Opens a replay file and writes its header. Records are made by the game as it
+ticks once g->rec is pointed at the replay
+---
+struct Replay * r: replay to start
+char * loc: location of the file to write
+unsigned int level: no. of the level the game starts on
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_recording( struct Replay * r, char * loc,
+			      unsigned int level )
+{
+        memset( r, 0, sizeof( *r ) );
+	memcpy( r->head.magic, "MDRP", 4 );
+	r->head.version = REPLAY_VERSION;
+	r->head.level = level;
+	r->head.coll_mode = COLL_MODE;
+
+	r->f = fopen( loc, "wb" );
+	if ( r->f == NULL ) {
+                fprintf( stderr, "Could not open replay file: %s\n", loc );
+		return 0;
+	}
+	fwrite( r->head.magic, 1, 4, r->f );
+	write_u32( r->f, r->head.version );
+	write_u32( r->f, r->head.level );
+	write_u32( r->f, r->head.coll_mode );
+	return 1;
+}
+
+/*
+void record()
+---
+Adds a record to a replay being recorded
+---
+struct Replay * r: replay to add to
+unsigned int tick: tick it was made on
+unsigned int type: INPUT_* or REC_* type of the record
+unsigned int a, b: values of the record
+*/
+void record( struct Replay * r, unsigned int tick, unsigned int type,
+	     unsigned int a, unsigned int b )
+{
+        if ( r->f == NULL )
+		return;
+	write_u32( r->f, tick );
+	fputc( type, r->f );
+	write_u32( r->f, a );
+	write_u32( r->f, b );
+	r->count++;
+}
+
+/*
+unsigned int stop_recording()
+---
+Ends a replay with a final check of the game, and closes its file
+---
+struct Replay * r: replay to stop
+struct Game * g: game it was recorded from
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int stop_recording( struct Replay * r, struct Game * g )
+{
+        if ( r->f == NULL )
+		return 0;
+	record( r, g->ticks, REC_END, hash_game( g ), g->curr_level );
+
+	unsigned int ok = !ferror( r->f );
+	if ( fclose( r->f ) != 0 )
+		ok = 0;
+	r->f = NULL;
+	if ( !ok )
+		fprintf( stderr, "Could not write replay file!\n" );
+	return ok;
+}
+
+/*
+unsigned int load_replay()
+---
+Reads a replay file in full, ready to play back by pointing g->play at it
+---
+struct Replay * r: replay to load into
+char * loc: location of the file
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int load_replay( struct Replay * r, char * loc )
+{
+        memset( r, 0, sizeof( *r ) );
+
+	FILE * f = fopen( loc, "rb" );
+	if ( f == NULL ) {
+                fprintf( stderr, "Could not open replay file: %s\n", loc );
+		return 0;
+	}
+
+	if ( fread( r->head.magic, 1, 4, f ) != 4 ||
+	     memcmp( r->head.magic, "MDRP", 4 ) != 0 ||
+	     !read_u32( f, &r->head.version ) ||
+	     r->head.version != REPLAY_VERSION ||
+	     !read_u32( f, &r->head.level ) ||
+	     !read_u32( f, &r->head.coll_mode ) ) {
+                fprintf( stderr, "Not a replay file, or a different "
+			 "version: %s\n", loc );
+		fclose( f );
+		return 0;
+	}
+	if ( r->head.coll_mode != COLL_MODE )
+		fprintf( stderr, "Replay was recorded with COLL_MODE=%u, this "
+			 "is COLL_MODE=%d, it won't play out the same\n",
+			 r->head.coll_mode, COLL_MODE );
+
+	/* the records are a fixed size, so the file size gives the count */
+	long start = ftell( f );
+	fseek( f, 0, SEEK_END );
+	long n = ( ftell( f ) - start ) / 13;
+	fseek( f, start, SEEK_SET );
+
+	r->recs = malloc( ( n > 0 ? n : 1 ) * sizeof( struct Replay_rec ) );
+	if ( r->recs == NULL ) {
+                fprintf( stderr, "Could not allocate replay!\n" );
+		fclose( f );
+		return 0;
+	}
+	for ( long i = 0; i < n; i++ ) {
+                struct Replay_rec * rec = &r->recs[i];
+		int type;
+		if ( !read_u32( f, &rec->tick ) ||
+		     ( type = fgetc( f ) ) == EOF ||
+		     !read_u32( f, &rec->a ) || !read_u32( f, &rec->b ) ) {
+                        fprintf( stderr, "Replay file cut short: %s\n", loc );
+			free_replay( r );
+			fclose( f );
+			return 0;
+		}
+		rec->type = type;
+	}
+	r->count = n;
+	fclose( f );
+	return 1;
+}
+
+/*
+void free_replay()
+---
+Frees a replay loaded with load_replay()
+---
+struct Replay * r: replay to free
+*/
+void free_replay( struct Replay * r )
+{
+        free( r->recs );
+	r->recs = NULL;
+	r->count = 0;
+	r->next = 0;
+}
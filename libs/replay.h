@@ -0,0 +1,159 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+/**
+replay.h
+---
+Header file for replay.c, used to store all accessible functions related to
+recording the inputs of a game, and playing them back tick for tick
+*/
+
+#include <stdio.h>
+
+#include "game.h"
+
+#define REPLAY_VERSION (1)
+#define REPLAY_CHECK_TICKS (60) /* ticks between checks of the game's state
+				   while playing */
+
+/* record types, besides the INPUT_* types (see game.h) */
+#define REC_RELOAD (8) /* level files reloaded, a = CHANGED_* flags */
+#define REC_LEVEL (9)  /* level loaded, a = state hash, b = level no. */
+#define REC_CHECK (10) /* a = state hash, b = level no. */
+#define REC_END (11)   /* recording stopped, a = state hash, b = level no. */
+
+/**
+struct Replay_header
+---
+Header at the start of a replay file, followed by its records. Everything in
+the file is little endian.
+---
+char magic[4]: "MDRP"
+unsigned int version: REPLAY_VERSION it was written with
+unsigned int level: no. of the level the game started on
+unsigned int coll_mode: COLL_MODE of the game, as the same inputs play out
+			differently in another mode
+*/
+struct Replay_header {
+        char magic[4];
+	unsigned int version;
+	unsigned int level;
+	unsigned int coll_mode;
+};
+
+/**
+struct Replay_rec
+---
+One record of a replay, 13 bytes in the file: the tick (4), the type (1), and
+a and b (4 each)
+---
+unsigned int tick: tick the record was made on
+unsigned int type: INPUT_* or REC_* type of the record
+unsigned int a, b: values of the record. The x and y of an input are stored
+		   as the bits of the floats, so they play back exactly
+*/
+struct Replay_rec {
+        unsigned int tick;
+	unsigned int type;
+	unsigned int a;
+	unsigned int b;
+};
+
+/**
+struct Replay
+---
+Replay being recorded to a file, or played back from one
+---
+FILE * f: file being recorded to, NULL if playing
+struct Replay_header head: header of the replay
+struct Replay_rec * recs: records to play back, NULL if recording
+unsigned int count: no. of records, written or to play
+unsigned int next: index of the next record to play
+unsigned int checks: no. of checks played back
+unsigned int desyncs: no. of checks the game didn't match
+unsigned int first_desync: tick of the first check not matched, 0 if none
+*/
+struct Replay {
+        FILE * f;
+	struct Replay_header head;
+	struct Replay_rec * recs;
+	unsigned int count;
+	unsigned int next;
+	unsigned int checks;
+	unsigned int desyncs;
+	unsigned int first_desync;
+};
+
+/*
+unsigned int start_recording()
+---
+Opens a replay file and writes its header. Records are made by the game as it
+ticks once g->rec is pointed at the replay
+---
+struct Replay * r: replay to start
+char * loc: location of the file to write
+unsigned int level: no. of the level the game starts on
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_recording( struct Replay *, char *, unsigned int );
+
+/*
+void record()
+---
+Adds a record to a replay being recorded
+---
+struct Replay * r: replay to add to
+unsigned int tick: tick it was made on
+unsigned int type: INPUT_* or REC_* type of the record
+unsigned int a, b: values of the record
+*/
+void record( struct Replay *, unsigned int, unsigned int, unsigned int,
+	     unsigned int );
+
+/*
+unsigned int stop_recording()
+---
+Ends a replay with a final check of the game, and closes its file
+---
+struct Replay * r: replay to stop
+struct Game * g: game it was recorded from
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int stop_recording( struct Replay *, struct Game * );
+
+/*
+unsigned int load_replay()
+---
+Reads a replay file in full, ready to play back by pointing g->play at it
+---
+struct Replay * r: replay to load into
+char * loc: location of the file
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int load_replay( struct Replay *, char * );
+
+/*
+void free_replay()
+---
+Frees a replay loaded with load_replay()
+---
+struct Replay * r: replay to free
+*/
+void free_replay( struct Replay * );
+
+/*
+unsigned int hash_game()
+---
+Hashes everything about a game that its inputs change: the level, score,
+camera, mouse and every projectile, bit for bit
+---
+struct Game * g: game to hash
+---
+Returns an unsigned int, the hash (FNV-1a)
+*/
+unsigned int hash_game( struct Game * );
+
+#endif //REPLAY_H_
@@ -7,6 +7,19 @@ modifying or freeing structures/unions.
 
 #include "structures.h"
 
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* chunks are rounded up to this, so everything handed out stays aligned */
+#define ARENA_ALIGN (16)
+#define ARENA_HEADER_SZ ( ( sizeof( struct Arena_chunk ) + ARENA_ALIGN - 1 ) \
+			  & ~(size_t)( ARENA_ALIGN - 1 ) )
+
+/* largest arena seen, levels are loaded on more than one thread */
+static atomic_size_t arena_peak;
+
 /*
 unsigned int initialize_tilemap()
 ---
@@ -25,6 +38,34 @@ unsigned int initialize_tilemap( struct Tilemap * tm,
 	tm->size = r * c;
 
 	tm->map = malloc(sizeof( char ) * tm->size );
+	tm->owned = 1;
+
+	if (tm->map == NULL)
+		return 0;
+	return 1;
+}
+
+/*
+unsigned int initialize_level_tilemap()
+---
+Initializes a given tilemap of a level, allocating it from the level's arena
+so it is freed along with the level
+---
+struct Level * l: level the tilemap belongs to
+struct Tilemap * tm: struct to initialize
+unsigned int r, c: rows and cols of tilemap
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_level_tilemap( struct Level * l, struct Tilemap * tm,
+				       unsigned int r, unsigned int c )
+{
+        tm->rows = r;
+	tm->cols = c;
+	tm->size = r * c;
+
+	tm->map = arena_alloc( &l->arena, sizeof( char ) * tm->size );
+	tm->owned = 0;
 
 	if (tm->map == NULL)
 		return 0;
@@ -85,8 +126,8 @@ unsigned int initialize_object ( struct Object *  o, float pos_x, float pos_y,
 /*
 unsigned int initialize_level()
 ---
-Initializes a given level with all necessary details about it, along
-with allocating some memory for the dynamic array object_arr.
+Initializes a given level with all necessary details about it, and starts
+the arena everything else allocated for the level comes from.
 ---
 struct Level * l: level to be initialized
 float start_x, start_y: player's starting position
@@ -116,15 +157,42 @@ unsigned int initialize_level ( struct Level * l,
 	unsigned int d = initialize_position( &l->gravity,
 					      gravity_x, gravity_y );
 	
-	/* set variables for using dynamic array */
-        l->size = OBJECT_ARR_SZ;
+	/* one screen, until tilemaps say otherwise */
+	l->width = 640;
+	l->height = 480;
+
+	/* everything below is allocated from here */
+	initialize_arena( &l->arena );
+
+	/* set variables for using dynamic array, allocated with the first
+	   object */
+        l->object_arr = NULL;
+        l->size = 0;
 	l->index = 0;
-	
-	/* allocate space for dynamic array */
-	l->object_arr = malloc( l->size * sizeof (struct Object) );
+
+	/* tilemaps are set up by whatever loads the level */
+	struct Tilemap * tms[3] = { &l->fg, &l->bg, &l->dec };
+	for ( int i = 0; i < 3; i++ ) {
+                tms[i]->map = NULL;
+		tms[i]->size = 0;
+		tms[i]->rows = 0;
+		tms[i]->cols = 0;
+		tms[i]->owned = 0;
+	}
+
+	/* grid is built once all objects are added */
+	l->grid.w = 0;
+	l->grid.h = 0;
+	l->grid.start = NULL;
+	l->grid.items = NULL;
+
+	/* allocate space for path cache */
+	l->paths.paths = arena_alloc( &l->arena,
+				      PATH_CACHE_SZ * sizeof (struct Path) );
+	reset_path_cache( l );
 
 	/* check if it failed */
-	if ( l->object_arr == NULL ) {
+	if ( l->paths.paths == NULL ) {
 	        fprintf( stderr, "Failed to malloc in initialize_level!\n" );
 	        return 0;
         }
@@ -138,7 +206,8 @@ unsigned int initialize_level ( struct Level * l,
 /*
 unsigned int add_object_to_level()
 ---
-Adds a struct Object to the object_arr in a given struct Level.
+Adds a struct Object to the object_arr in a given struct Level. The array is
+grown if it is full.
 ---
 struct Level * l: level to be added to
 struct Object o: objecto to be added
@@ -147,11 +216,23 @@ Returns 1 on success, 0 on fail
 */
 unsigned int add_object_to_level ( struct Level * l, struct Object o )
 {
-	/* check if the array is full */
+	/* check if the array is full (or not allocated yet) */
 	if (l->size == l->index)
 	{
-                fprintf(stderr, "Too many objects in level!\n");
-		return 0;
+		/* double the size of the array. the old one is left in the
+		   arena (or the level.bin), so there is nothing to free */
+		unsigned int size = l->size ? 2 * l->size : OBJECT_ARR_SZ;
+                struct Object * arr = arena_alloc( &l->arena, size *
+						   sizeof (struct Object) );
+		if ( arr == NULL ) {
+			fprintf(stderr, "Too many objects in level!\n");
+			return 0;
+		}
+		if ( l->index > 0 )
+			memcpy( arr, l->object_arr,
+				l->index * sizeof (struct Object) );
+		l->object_arr = arr;
+		l->size = size;
 	}
 
 	/* add object to array */
@@ -159,14 +240,38 @@ unsigned int add_object_to_level ( struct Level * l, struct Object o )
 			   o.dims.x, o.dims.y, o.type, 0, 0, 0 );
 	l->index++;
 
+	/* cached paths may go through the new object */
+	reset_path_cache( l );
+
 	return 1;
 };
 
+/*
+void reset_path_cache()
+---
+Empties the path cache of a level, must be called if anything the paths depend
+on changes (objects, wind, gravity, start position)
+---
+struct Level * l: level to reset the path cache of
+*/
+void reset_path_cache( struct Level * l )
+{
+	l->paths.clock = 0;
+	if ( l->paths.paths == NULL )
+		return;
+	
+        for ( int i = 0; i < PATH_CACHE_SZ; i++ ) {
+                l->paths.paths[i].n = 0;
+		l->paths.paths[i].last_used = 0;
+	}
+}
+
 /*
 unsigned int free_level()
 ---
-Frees the memory allocated to the object array and resets size and
-index of the object array
+Frees everything allocated for a level (object array, tilemaps, grid, path
+cache and the level.bin it was loaded from, if any) with a single reset of its
+arena, and resets size and index of the object array.
 ---
 struct Level * l: level to be freed
 ---
@@ -174,7 +279,21 @@ Returns 1 on success, 0 on fail
 */
 unsigned int free_level ( struct Level * l )
 {
-        free( l->object_arr );
+        struct Tilemap * tms[3] = { &l->fg, &l->bg, &l->dec };
+
+        reset_arena( &l->arena );
+	l->object_arr = NULL;
+	l->paths.paths = NULL;
+	l->grid.start = NULL;
+	l->grid.items = NULL;
+	l->grid.w = 0;
+	l->grid.h = 0;
+	for ( int i = 0; i < 3; i++ ) {
+                tms[i]->map = NULL;
+		tms[i]->size = 0;
+		tms[i]->rows = 0;
+		tms[i]->cols = 0;
+	}
 	l->size = 0;
 	l->index = 0;
 
@@ -182,76 +301,414 @@ unsigned int free_level ( struct Level * l )
 	return 1;
 };
 
+/*
+static void get_cell_range()
+---
+Gets the range of cells an object overlaps, clamped to the grid. Edges count
+as overlapping, same as in is_collide().
+---
+struct Grid * g: grid to use
+struct Object * o: object to use
+unsigned int * x0, * y0, * x1, * y1: first and last cell across and down
+---
+Returns range of cells [implicit]
+*/
+static void get_cell_range( struct Grid * g, struct Object * o,
+			    unsigned int * x0, unsigned int * y0,
+			    unsigned int * x1, unsigned int * y1 )
+{
+	float bounds[4] = { o->pos.x, o->pos.y - o->dims.y,
+			    o->pos.x + o->dims.x, o->pos.y };
+	unsigned int max[4] = { g->w - 1, g->h - 1, g->w - 1, g->h - 1 };
+	unsigned int * cells[4] = { x0, y0, x1, y1 };
+
+	for ( int i = 0; i < 4; i++ ) {
+                float c = floorf( bounds[i] / CELL_SZ );
+		if ( c < 0 )
+			*cells[i] = 0;
+		else if ( c > max[i] )
+			*cells[i] = max[i];
+		else
+			*cells[i] = c;
+	}
+}
+
+/*
+unsigned int initialize_grid()
+---
+Builds the collision grid of a level from its object_arr, in the level's
+arena. Must be called again if objects are added to the level.
+---
+struct Level * l: level to build the grid for
+unsigned int w, h: no. of cells across and down
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_grid( struct Level * l, unsigned int w,
+			      unsigned int h )
+{
+	struct Grid * g = &l->grid;
+	unsigned int x0, y0, x1, y1;
+	unsigned int total = 0;
+	
+	/* an old grid is left in the arena */
+	g->w = w;
+	g->h = h;
+	g->items = NULL;
+	g->start = arena_alloc( &l->arena,
+				( w * h + 1 ) * sizeof( unsigned int ) );
+	if ( g->start == NULL ) {
+                fprintf( stderr, "Could not initialize grid!\n" );
+		g->w = 0;
+		g->h = 0;
+		return 0;
+	}
+	memset( g->start, 0, ( w * h + 1 ) * sizeof( unsigned int ) );
+
+	/* count objects in each cell */
+	for ( unsigned int i = 0; i < l->index; i++ ) {
+                get_cell_range( g, &l->object_arr[i], &x0, &y0, &x1, &y1 );
+		for ( unsigned int y = y0; y <= y1; y++ ) {
+			for ( unsigned int x = x0; x <= x1; x++ ) {
+                                g->start[y * w + x + 1]++;
+				total++;
+			}
+		}
+	}
+
+	/* turn counts into where each cell starts */
+	for ( unsigned int c = 0; c < w * h; c++ )
+                g->start[c + 1] += g->start[c];
+
+	/* fill is only needed while building, so isn't kept in the arena */
+	g->items = arena_alloc( &l->arena,
+				( total + 1 ) * sizeof( unsigned int ) );
+	unsigned int * fill = malloc( w * h * sizeof( unsigned int ) );
+	if ( g->items == NULL || fill == NULL ) {
+                fprintf( stderr, "Could not initialize grid!\n" );
+		free( fill );
+		g->start = NULL;
+		g->items = NULL;
+		g->w = 0;
+		g->h = 0;
+		return 0;
+	}
+
+	/* put each object in its cells, keeping object_arr order */
+	for ( unsigned int c = 0; c < w * h; c++ )
+                fill[c] = g->start[c];
+	for ( unsigned int i = 0; i < l->index; i++ ) {
+                get_cell_range( g, &l->object_arr[i], &x0, &y0, &x1, &y1 );
+		for ( unsigned int y = y0; y <= y1; y++ ) {
+			for ( unsigned int x = x0; x <= x1; x++ )
+                                g->items[fill[y * w + x]++] = i;
+		}
+	}
+	free( fill );
+
+	return 1;
+}
+
+/*
+void initialize_arena()
+---
+Initializes an empty arena, nothing is allocated until it is first used
+---
+struct Arena * a: arena to initialize
+*/
+void initialize_arena( struct Arena * a )
+{
+        a->chunks = NULL;
+	a->maps = NULL;
+	a->used = 0;
+	a->high = 0;
+}
+
+/*
+void * arena_alloc()
+---
+Allocates memory from an arena, which stays valid until the arena is reset.
+Memory is aligned to 16 bytes and not cleared. A new chunk is started when the
+current one is full, at least ARENA_CHUNK_SZ in size so a level normally only
+needs one.
+---
+struct Arena * a: arena to allocate from
+size_t size: no. of bytes
+---
+Returns a void *, the memory, or NULL on fail
+*/
+void * arena_alloc( struct Arena * a, size_t size )
+{
+        struct Arena_chunk * c = a->chunks;
+	size = ( size + ARENA_ALIGN - 1 ) & ~(size_t)( ARENA_ALIGN - 1 );
+
+	if ( c == NULL || c->size - c->used < size ) {
+                size_t csize = size > ARENA_CHUNK_SZ ? size : ARENA_CHUNK_SZ;
+		c = malloc( ARENA_HEADER_SZ + csize );
+		if ( c == NULL ) {
+                        fprintf( stderr, "Could not grow level arena!\n" );
+			return NULL;
+		}
+		c->size = csize;
+		c->used = 0;
+		c->next = a->chunks;
+		a->chunks = c;
+	}
+
+	void * p = (char *)c + ARENA_HEADER_SZ + c->used;
+	c->used += size;
+	a->used += size;
+	if ( a->used > a->high )
+		a->high = a->used;
+	return p;
+}
+
+/*
+unsigned int arena_add_map()
+---
+Hands a file mapping over to an arena, so it is unmapped when the arena is
+reset
+---
+struct Arena * a: arena to own the mapping
+void * addr: start of the mapping
+size_t len: length of the mapping
+---
+Returns 1 on success, 0 on fail (the mapping is left alone)
+*/
+unsigned int arena_add_map( struct Arena * a, void * addr, size_t len )
+{
+        struct Arena_map * m = arena_alloc( a, sizeof( struct Arena_map ) );
+	if ( m == NULL )
+		return 0;
+	m->addr = addr;
+	m->len = len;
+	m->next = a->maps;
+	a->maps = m;
+	return 1;
+}
+
+/*
+void reset_arena()
+---
+Frees every allocation and mapping of an arena at once, leaving it empty and
+ready to be used again
+---
+struct Arena * a: arena to reset
+*/
+void reset_arena( struct Arena * a )
+{
+        size_t peak = atomic_load( &arena_peak );
+
+	/* mappings are recorded in the chunks, so unmap them first */
+	for ( struct Arena_map * m = a->maps; m != NULL; m = m->next )
+		munmap( m->addr, m->len );
+	while ( a->chunks != NULL ) {
+                struct Arena_chunk * next = a->chunks->next;
+		free( a->chunks );
+		a->chunks = next;
+	}
+
+	while ( a->high > peak &&
+		!atomic_compare_exchange_weak( &arena_peak, &peak, a->high ) )
+		;
+	a->maps = NULL;
+	a->used = 0;
+}
+
+/*
+size_t get_arena_peak()
+---
+Gets the most memory any arena has had handed out at once, up to its last
+reset, for sizing ARENA_CHUNK_SZ
+---
+Returns a size_t, no. of bytes
+*/
+size_t get_arena_peak()
+{
+        return atomic_load( &arena_peak );
+}
+
 /*
 unsigned int initialize_proj_arr()
 ---
-Initializes a given Proj_arr with default values
+Initializes a given Proj_arr with default values. Every float field shares one
+allocation, each array starting on a 16 byte boundary so they can be loaded 4
+floats at a time. The id, slot and gen arrays share another. Every id starts in
+the free list, lowest first. Room is made for one trigger event per projectile.
 ---
 struct Proj_arr *: struct to initialize
+unsigned int size: number of projectiles to make room for (normally
+		   PROJ_ARR_SZ), more are made room for as needed
 ---
 Returns 1 on success, 0 on fail
 */
-unsigned int initialize_proj_arr( struct Proj_arr * p ) {
-        p->size = PROJ_ARR_SZ;
-	p->index = 0;
+unsigned int initialize_proj_arr( struct Proj_arr * p, unsigned int size ) {
+        if ( size == 0 )
+		size = 1;
+        /* round each array up to a multiple of 4 floats */
+        unsigned int stride = ( size + 3 ) & ~3u;
+	
+        p->size = size;
+	p->count = 0;
+	p->newest.id = 0;
+	p->newest.gen = 0;
 
-	p->arr = malloc( sizeof( struct Projectile ) * p->size );
+	p->x = calloc( (size_t)stride * 11, sizeof( float ) );
+	p->p_coll = calloc( stride, sizeof( int ) );
+	p->e_type = calloc( stride, sizeof( unsigned int ) );
+	p->id = calloc( (size_t)stride * 3, sizeof( unsigned int ) );
+	p->events = malloc( size * sizeof( struct Trigger_event ) );
+	p->n_events = 0;
+	p->events_size = size;
 
-	if ( p->arr == NULL ) {
+	if ( p->x == NULL || p->p_coll == NULL || p->e_type == NULL ||
+	     p->id == NULL || p->events == NULL ) {
                 fprintf(stderr, "Could not initialize projectile arr!\n");
+		free_proj_arr( p );
 		return 0;
 	}
+	p->slot = p->id + stride;
+	p->gen = p->slot + stride;
+	for ( unsigned int i = 0; i < size; i++ ) {
+                p->slot[i] = i + 1;
+		p->gen[i] = 1;
+	}
+	p->free_id = 0;
+
+	p->y = p->x + stride;
+	p->px = p->y + stride;
+	p->py = p->px + stride;
+	p->sx = p->py + stride;
+	p->sy = p->sx + stride;
+	p->vx = p->sy + stride;
+	p->vy = p->vx + stride;
+	p->time = p->vy + stride;
+	p->g_time = p->time + stride;
+	p->t_event = p->g_time + stride;
+	return 1;
+}
+
+/*
+void free_proj_arr()
+---
+Frees the memory allocated to a given Proj_arr
+---
+struct Proj_arr * p: struct to free
+*/
+void free_proj_arr( struct Proj_arr * p )
+{
+        free( p->x );
+	free( p->p_coll );
+	free( p->e_type );
+	free( p->id );
+	free( p->events );
+	p->x = NULL;
+	p->p_coll = NULL;
+	p->e_type = NULL;
+	p->id = NULL;
+	p->events = NULL;
+	p->n_events = 0;
+	p->events_size = 0;
+	p->size = 0;
+	p->count = 0;
+	p->free_id = 0;
+}
+
+/*
+static unsigned int grow_proj_arr()
+---
+Doubles the no. of projectiles a full Proj_arr can hold. Projectiles keep their
+index and id, so handles to them stay valid
+---
+struct Proj_arr * p: struct to grow
+---
+Returns 1 on success, 0 on fail (p is left as it was)
+*/
+static unsigned int grow_proj_arr( struct Proj_arr * p )
+{
+        struct Proj_arr n;
+	size_t old_stride = p->y - p->x;
+	
+	if ( !initialize_proj_arr( &n, p->size * 2 ) )
+		return 0;
+
+	/* float arrays are laid out in the same order in both */
+	size_t new_stride = n.y - n.x;
+	for ( unsigned int f = 0; f < 11; f++ )
+		memcpy( n.x + f * new_stride, p->x + f * old_stride,
+			p->count * sizeof( float ) );
+	memcpy( n.p_coll, p->p_coll, p->count * sizeof( int ) );
+	memcpy( n.e_type, p->e_type, p->count * sizeof( unsigned int ) );
+	memcpy( n.id, p->id, p->count * sizeof( unsigned int ) );
+	memcpy( n.slot, p->slot, p->size * sizeof( unsigned int ) );
+	memcpy( n.gen, p->gen, p->size * sizeof( unsigned int ) );
+	memcpy( n.events, p->events,
+		p->n_events * sizeof( struct Trigger_event ) );
+	n.n_events = p->n_events;
+
+	/* every old id is in use, so only the new ones are free */
+	n.free_id = p->size;
+	n.count = p->count;
+	n.newest = p->newest;
+
+	free_proj_arr( p );
+	*p = n;
 	return 1;
 }
 
 /*
 unsigned int initialize_projectile()
 ---
-Initializes a struct Projectile with given values
+Initializes the projectile at a given index of a Proj_arr with given values
 ---
-struct Projectile * p: struct to initialize
+struct Proj_arr * p: struct to initialize in
+unsigned int i: index of the projectile
 struct Position * v: velocity of projectile
 struct Position * s_pos: starting position of projectile
 ---
 Returns 1 on success, 0 on fail
 */
-static unsigned int initialize_projectile( struct Projectile * p,
-				    struct Position * v,
-				    struct Position * s_pos )
+static unsigned int initialize_projectile( struct Proj_arr * p, unsigned int i,
+					   struct Position * v,
+					   struct Position * s_pos )
 {
-        p->active = 1;
 	/* all start at the same values */
-	initialize_position( &p->s_pos, s_pos->x, s_pos->y );
-	initialize_position( &p->p_pos, s_pos->x, s_pos->y );
-	initialize_position( &p->pos, s_pos->x, s_pos->y );
+	p->sx[i] = p->px[i] = p->x[i] = s_pos->x;
+	p->sy[i] = p->py[i] = p->y[i] = s_pos->y;
 
-	initialize_position( &p->vel, v->x, v->y );
+	p->vx[i] = v->x;
+	p->vy[i] = v->y;
 
-	p->time = 0;
-	p->g_time = 0;
-	p->p_coll = 4;
+	p->time[i] = 0;
+	p->g_time[i] = 0;
+	p->p_coll[i] = 1;
+	p->t_event[i] = -1;
 
 	/* function cannot fail in normal use */
 	return 1;
 }
 
 /*
-unsigned int add_to_proj_arr()
+struct Proj_handle add_to_proj_arr()
 ---
-Initializes a new projectile in proj_arr with given values
+Initializes a new projectile in proj_arr with given values, making room for it
+if the arrays are full. Projectiles already in flight are never replaced
 ---
 struct Proj_arr * p: Proj_arr to add to
 struct Position * m: mouse Position
 struct Position s_pos: starting pos of projectile
 ---
-Returns nothing
+Returns a struct Proj_handle of the new projectile, with gen 0 if there was no
+room for it
 */
-void add_to_proj_arr( struct Proj_arr * p, struct Position * m,
-		      struct Position s_pos )
+struct Proj_handle add_to_proj_arr( struct Proj_arr * p, struct Position * m,
+				    struct Position s_pos )
 {
-        if (p->index == p->size) {
-                /* wrap around */
-		p->index = 0;
+        struct Proj_handle h = { 0, 0 };
+	
+        if ( p->free_id == p->size && !grow_proj_arr( p ) ) {
+                fprintf( stderr, "Could not make room for projectile!\n" );
+		return h;
 	}
         /* adjust s_pos for which way the player is facing*/
 	if ( m->x < (s_pos.x+13) ) {
@@ -266,8 +723,123 @@ void add_to_proj_arr( struct Proj_arr * p, struct Position * m,
 	struct Position vel;
         get_velocity_from_mouse( &vel, &s_pos, m );
 	
-	initialize_projectile(&p->arr[p->index], &vel, &s_pos );
-	p->index++;
+	/* take the first free id, and the first free index */
+	unsigned int i = p->count++;
+	h.id = p->free_id;
+	h.gen = p->gen[h.id];
+	p->free_id = p->slot[h.id];
+	p->slot[h.id] = i;
+	p->id[i] = h.id;
+	
+	initialize_projectile( p, i, &vel, &s_pos );
+	p->newest = h;
+	return h;
+}
+
+/*
+int get_projectile()
+---
+Finds where a projectile is in the arrays of a Proj_arr
+---
+struct Proj_arr * p: Proj_arr to look in
+struct Proj_handle h: handle of the projectile
+---
+Returns an int, index of the projectile, -1 if it has been removed
+*/
+int get_projectile( struct Proj_arr * p, struct Proj_handle h )
+{
+        if ( h.gen == 0 || h.id >= p->size || p->gen[h.id] != h.gen )
+		return -1;
+	return p->slot[h.id];
+}
+
+/*
+static void free_proj_id()
+---
+Puts the id of a removed projectile back in the free list, moving its
+generation on so any handle to the projectile stops being valid
+---
+struct Proj_arr * p: Proj_arr the id belongs to
+unsigned int id: id to free
+*/
+static void free_proj_id( struct Proj_arr * p, unsigned int id )
+{
+        /* 0 is never a valid generation */
+        if ( ++p->gen[id] == 0 )
+		p->gen[id] = 1;
+	p->slot[id] = p->free_id;
+	p->free_id = id;
+}
+
+/*
+void remove_from_proj_arr()
+---
+Removes a projectile from a Proj_arr. The last projectile is moved into its
+place, so when looping over the arrays, the same index has to be looked at
+again
+---
+struct Proj_arr * p: Proj_arr to remove from
+unsigned int i: index of the projectile
+*/
+void remove_from_proj_arr( struct Proj_arr * p, unsigned int i )
+{
+        unsigned int last = --p->count;
+	
+	free_proj_id( p, p->id[i] );
+	if ( i == last )
+		return;
+
+	p->x[i] = p->x[last];
+	p->y[i] = p->y[last];
+	p->px[i] = p->px[last];
+	p->py[i] = p->py[last];
+	p->sx[i] = p->sx[last];
+	p->sy[i] = p->sy[last];
+	p->vx[i] = p->vx[last];
+	p->vy[i] = p->vy[last];
+	p->time[i] = p->time[last];
+	p->g_time[i] = p->g_time[last];
+	p->t_event[i] = p->t_event[last];
+	p->p_coll[i] = p->p_coll[last];
+	p->e_type[i] = p->e_type[last];
+	p->id[i] = p->id[last];
+	p->slot[p->id[i]] = i;
+}
+
+/*
+unsigned int add_trigger_event()
+---
+Records a projectile entering a trigger volume, making room for the event if
+needed
+---
+struct Proj_arr * p: Proj_arr the projectile is in
+unsigned int i: index of the projectile
+unsigned int obj: index in object_arr of the trigger
+unsigned int type: type of the trigger
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int add_trigger_event( struct Proj_arr * p, unsigned int i,
+				unsigned int obj, unsigned int type )
+{
+        if ( p->n_events == p->events_size ) {
+                unsigned int size = p->events_size * 2;
+		struct Trigger_event * e = realloc( p->events, size *
+						    sizeof( struct Trigger_event ) );
+		if ( e == NULL ) {
+                        fprintf( stderr, "Could not record trigger event!\n" );
+			return 0;
+		}
+		p->events = e;
+		p->events_size = size;
+	}
+
+	struct Trigger_event * e = &p->events[p->n_events++];
+	e->proj.id = p->id[i];
+	e->proj.gen = p->gen[p->id[i]];
+	e->obj = obj;
+	e->type = type;
+	return 1;
 }
 
 /*
@@ -282,7 +854,10 @@ Returns 1 on success, 0 on fail
 */
 void free_tilemap( struct Tilemap * tm )
 {
-        free(tm->map);
+        /* maps of a level are freed with the level */
+        if ( tm->owned )
+		free(tm->map);
+	tm->map = NULL;
 	tm->size = 0;
 	tm->rows = 0;
 	tm->cols = 0;
@@ -291,15 +866,22 @@ void free_tilemap( struct Tilemap * tm )
 /*
 void reset_proj_arr()
 ---
-Resets a given proj_arr for use when changing levels
+Resets a given proj_arr for use when changing levels. Removes every projectile
+in flight, then puts the free list back in order, so ids are handed out from 0
+again
 ---
 struct Proj_arr * proj_arr: struct to reset
 */
 void reset_proj_arr( struct Proj_arr * proj_arr )
 {
-        for (int p = 0; p < proj_arr->size; p++) {
-		proj_arr->arr[p].active = 0;
-	}
+        for ( unsigned int p = 0; p < proj_arr->count; p++ )
+		free_proj_id( proj_arr, proj_arr->id[p] );
 	
-	proj_arr->index = 0;
+	for ( unsigned int id = 0; id < proj_arr->size; id++ )
+		proj_arr->slot[id] = id + 1;
+	proj_arr->free_id = 0;
+	proj_arr->count = 0;
+	proj_arr->n_events = 0;
+	proj_arr->newest.id = 0;
+	proj_arr->newest.gen = 0;
 }
@@ -10,37 +10,33 @@ function declarations for publicly accessible function from structures.c
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <allegro5/allegro_image.h> /* needed for struct bitmap */
-#include <allegro5/allegro.h> /* needed for struct bitmap */
+#include <stdint.h> /* needed for struct Level_header */
 
 #define OBJECT_ARR_SZ (32)
-#define PROJ_ARR_SZ (32)
-
-/**
-struct Bitmap
----
-Bitmap struct used to store all images needed for the game.
-*/
-struct Bitmap {
-        ALLEGRO_BITMAP * ts;         //combined tileset for all levels
-	ALLEGRO_BITMAP * plyr;       //player
-	ALLEGRO_BITMAP * plyr_bow;   //bow
-	ALLEGRO_BITMAP * proj;       //arrow
-	ALLEGRO_BITMAP * water;      //water texture
-	ALLEGRO_BITMAP * font;       //font tileset
-	ALLEGRO_BITMAP * bg;         //start menu's bg
-	ALLEGRO_BITMAP * target;     //target bmp
-};
+#define PROJ_ARR_SZ (32) /* starting capacity of a Proj_arr, doubled when
+			    full */
+#define TILE_SZ (32) /* size of a tile on screen (px) */
+#define CELL_SZ (32) /* size of a broadphase cell, same as a tile */
+#define PATH_CACHE_SZ (8) /* no. of aim previews kept per level */
+#define PATH_MAX_PTS (512) /* max no. of points in an aim preview */
+#define PATH_QUANT (2) /* size of the grid the mouse is snapped to (px) */
+#define OBJ_TRIGGER (16) /* object types from this up are trigger volumes */
+#define OBJ_TARGET (16) /* trigger entered to win the level */
+#define ARENA_CHUNK_SZ (65536) /* size of a level arena chunk, enough for any
+				  shipped level in one */
 
 /**
 struct Tilemap
 ---
 Tilemap struct used to store data about a given tilemap (i.e. fg, bg, dec, etc)
 ---
-unsigned int rows, cols: no of rows/cols
+unsigned int rows, cols: no of tiles across/down
 unsigned int size: size of tilemap (equal to rows*cols)
 char * map: tilemap data (each tile is stored sequentially from left to right,
-            top to bottom, tiles are stored as hex characters '0'-'9','A'-'F')
+            top to bottom, tiles are stored as tile indices 0-15, or 16 for no
+	    tile. the files store them as hex characters '0'-'9','A'-'F')
+unsigned int owned: 1 if map was allocated for the tilemap, 0 if it belongs to
+                    a level (its arena, or the mapping of a level.bin)
 */
 struct Tilemap
 {
@@ -48,6 +44,7 @@ struct Tilemap
 	unsigned int cols;
 	char * map;
 	unsigned int size;
+	unsigned int owned;
 };
 
 /**
@@ -66,7 +63,10 @@ struct Position
 struct Object
 ---
 Object struct used to store all relevant data about an object.
-Objects can be colliders, jump pads, reboundable walls, etc.
+Objects can be colliders, jump pads, reboundable walls, etc. Objects with a
+type of OBJ_TRIGGER or more are trigger volumes (the target, etc.), which
+projectiles pass through, with an event recorded as they enter (see struct
+Trigger_event).
 ---
 struct Position pos: position of bottom left corner of object
 struct Position dims: width and height of position
@@ -83,6 +83,117 @@ struct Object
 	struct Position end_pos;
 };
 
+/**
+struct Grid
+---
+Grid struct used as a broadphase for collisions. The level is split into
+CELL_SZ x CELL_SZ cells, and each cell lists the objects overlapping it, so a
+collision check only has to look at the objects in one cell.
+---
+unsigned int w, h: no. of cells across and down
+unsigned int * start: index into items of the first object of each cell. the
+                      objects of cell i are items[start[i]] to
+                      items[start[i+1]-1] (size is w*h+1)
+unsigned int * items: indices into object_arr, grouped by cell and in the
+                      same order as object_arr
+*/
+struct Grid
+{
+        unsigned int w;
+	unsigned int h;
+	unsigned int * start;
+	unsigned int * items;
+};
+
+/**
+struct Path
+---
+Path struct used to store the aim preview of a throw
+---
+int qx, qy: mouse position the path was aimed at, divided by PATH_QUANT
+unsigned int last_used: when the path was last used (see struct Path_cache)
+unsigned int n: no. of points in pts, 0 if the path is unused
+struct Position pts[]: points along the path, one per frame
+*/
+struct Path
+{
+        int qx;
+	int qy;
+	unsigned int last_used;
+	unsigned int n;
+	struct Position pts[PATH_MAX_PTS];
+};
+
+/**
+struct Path_cache
+---
+Path_cache struct used to keep the most recently used aim previews of a level,
+so the preview is only recalculated when the aim changes
+---
+struct Path * paths: array of PATH_CACHE_SZ paths
+unsigned int clock: incremented each time a path is requested, used to find
+                    the least recently used path
+*/
+struct Path_cache
+{
+        struct Path * paths;
+	unsigned int clock;
+};
+
+/**
+struct Arena_chunk
+---
+Block of memory that arena allocations are carved out of. The memory handed
+out follows the header, starting on a 16 byte boundary.
+---
+struct Arena_chunk * next: chunk allocated before this one
+size_t size: no. of bytes after the header
+size_t used: no. of bytes handed out
+*/
+struct Arena_chunk
+{
+        struct Arena_chunk * next;
+	size_t size;
+	size_t used;
+};
+
+/**
+struct Arena_map
+---
+Records a file mapping owned by an arena, kept inside the arena itself
+---
+struct Arena_map * next: mapping added before this one
+void * addr: start of the mapping
+size_t len: length of the mapping
+*/
+struct Arena_map
+{
+        struct Arena_map * next;
+	void * addr;
+	size_t len;
+};
+
+/**
+struct Arena
+---
+Arena struct used to own everything that lives as long as a level (objects,
+tilemaps, grid, path cache and level.bin mapping). Allocations are bumped out
+of chunks of ARENA_CHUNK_SZ and never freed one at a time; the whole arena is
+released with reset_arena() instead.
+---
+struct Arena_chunk * chunks: newest chunk, allocations are made from it
+struct Arena_map * maps: newest file mapping, unmapped on reset
+size_t used: no. of bytes handed out since the last reset
+size_t high: most bytes that were ever handed out at once
+*/
+struct Arena
+{
+        struct Arena_chunk * chunks;
+	struct Arena_map * maps;
+	size_t used;
+	size_t high;
+};
+
 /**
 struct Level
 ---
@@ -94,9 +205,15 @@ struct Position wind: x,y comps of force (wind)
 struct Position gravity: x,y comps of force (gravity)
 struct Object * object_arr: array of objects in level
 struct Tilemap fg, bg, dec: tilemaps of level
+struct Grid grid: broadphase for object_arr
+struct Path_cache paths: recently used aim previews
 unsigned int size: size of object_arr
 unsigned int index: index of object_arr
 unsigned int level: which level number the level is
+float width, height: size of the level (px), anything outside is out of
+                     bounds. one screen unless loaded from tilemaps
+struct Arena arena: owns object_arr, the tilemaps, grid and path cache, along
+                    with the level.bin they may point into
 */
 struct Level
 {
@@ -108,50 +225,158 @@ struct Level
 	struct Tilemap fg;
 	struct Tilemap bg;
 	struct Tilemap dec;
+	struct Grid grid;
+	struct Path_cache paths;
 	unsigned int size;
 	unsigned int index;
 	unsigned int level;
+	float width;
+	float height;
+	struct Arena arena;
 };
 
 /**
-struct Projectile
----
-Projectile struct used to store data about a given projectile. Allows
-multiple projectiles to be active at the same time.
----
-unsigned int active: whether the projectile is active
-struct Position s_pos: starting pos of the projectile
-struct Position p_pos: previous pos of the projectile
-struct Position vel: velocity
-float time: time of the proj
-float g_time: global time of the projectile (used for despawning)
-int p_coll: prevous 4-step collision. used to check when a projectile
-	    can no longer move (i.e. collided with no rebound/jump)
-*/
-struct Projectile {
-        unsigned int active;
-	struct Position s_pos;
-	struct Position p_pos;
-	struct Position pos;
-	struct Position vel;
-	float time;
-	float g_time;
-	int p_coll;
+struct Level_header
+---
+Header of a compiled level (levels/N/level.bin, made by tools/levelc.c). The
+header is followed by the level's objects as an array of struct Object, then
+the fg, bg and dec tilemaps as rows*cols tile indices each, all laid out the
+same as they are at runtime so loading is just a check and pointing into the
+file. Written in the byte order of the machine that compiled it.
+---
+char magic[4]: always LEVEL_MAGIC
+uint32_t version: LEVEL_VERSION the file was written with
+uint32_t checksum: FNV-1a hash of everything after the header
+uint32_t size: no. of bytes after the header
+uint32_t object_sz: sizeof (struct Object) the file was written with
+uint32_t n_objects: no. of objects
+uint32_t rows, cols: size of each tilemap
+float start_x, start_y: player's starting position
+float target_x, target_y: target's position
+float wind_x, wind_y: force acting on the projectile
+float gravity_x, gravity_y: gravity acting on the projectile
+*/
+struct Level_header
+{
+        char magic[4];
+	uint32_t version;
+	uint32_t checksum;
+	uint32_t size;
+	uint32_t object_sz;
+	uint32_t n_objects;
+	uint32_t rows;
+	uint32_t cols;
+	float start_x;
+	float start_y;
+	float target_x;
+	float target_y;
+	float wind_x;
+	float wind_y;
+	float gravity_x;
+	float gravity_y;
 };
 
 /**
-struct Proj_arr
+struct Proj_handle
 ---
-Struct to store all active and non-active projectile currently in a level
+Handle to a projectile in a Proj_arr. Stays valid while the projectile moves
+around the arrays, and stops being valid once it is removed, even if its id is
+reused by a newer projectile (see get_projectile()).
 ---
-struct Projectile * arr: array of Projectile objects
-unsigned int size: size of arr
-unsigned int index: current index of arr
+unsigned int id: id of the projectile
+unsigned int gen: generation of the id when the projectile was added, never 0
+		  for a valid handle
+*/
+struct Proj_handle {
+        unsigned int id;
+	unsigned int gen;
+};
+
+/**
+struct Trigger_event
+---
+Records a projectile entering a trigger volume during simulate_step()
+---
+struct Proj_handle proj: projectile that entered the trigger
+unsigned int obj: index in object_arr of the trigger
+unsigned int type: type of the trigger (OBJ_TARGET, etc.)
+*/
+struct Trigger_event {
+        struct Proj_handle proj;
+	unsigned int obj;
+	unsigned int type;
+};
+
+/**
+struct Proj_arr
+---
+Struct to store every projectile currently in flight in a level. Stored as a
+struct of arrays, one array per field indexed by projectile, so the fields
+needed every frame (positions, velocities and times) are packed together and
+can be advanced several projectiles at a time (see advance_projectiles()). The
+fields only read once a projectile has moved (p_coll, etc.) are kept apart
+from them.
+
+Projectiles in flight are packed into the first count entries of each array.
+Removing one moves the last into its place, so anything that loops over
+projectiles only visits those in flight. As projectiles move, each is also
+given an id that doesn't, which struct Proj_handle refers to. Ids not in use
+are kept in a free list. The arrays are doubled in size when full.
+---
+float * x, * y: current pos of each projectile
+float * px, * py: previous pos of each projectile
+float * sx, * sy: starting pos of each projectile
+float * vx, * vy: velocity of each projectile
+float * time: time of each proj
+float * g_time: global time of each projectile (used for despawning)
+float * t_event: time of the next event (only used with COLL_EVENT), -1 if it
+                 needs solving for again
+int * p_coll: previous collision result, 0 if the last step could not move at
+	      all. used to check when a projectile can no longer move (i.e.
+	      collided with no rebound/jump)
+unsigned int * e_type: type of the next event (see next_event())
+unsigned int * id: id of each projectile
+unsigned int * slot: index in the arrays above of each id in use, or the next
+		     id in the free list for ids not in use
+unsigned int * gen: current generation of each id, moved on when the
+		    projectile using it is removed
+unsigned int size: number of projectiles the arrays can hold
+unsigned int count: number of projectiles in flight
+unsigned int free_id: first id in the free list, size if it is empty
+struct Proj_handle newest: handle of the projectile added last
+struct Trigger_event * events: triggers entered during the last
+			       simulate_step(), in the order they were entered
+unsigned int n_events: no. of events in events
+unsigned int events_size: no. of events there is room for
 */
 struct Proj_arr {
-        struct Projectile *  arr;
+        float * x;
+	float * y;
+	float * px;
+	float * py;
+	float * sx;
+	float * sy;
+	float * vx;
+	float * vy;
+	float * time;
+
+	float * g_time;
+	float * t_event;
+	int * p_coll;
+	unsigned int * e_type;
+
+	unsigned int * id;
+	unsigned int * slot;
+	unsigned int * gen;
+	
 	unsigned int size;
-	unsigned int index;
+	unsigned int count;
+	unsigned int free_id;
+	struct Proj_handle newest;
+
+	struct Trigger_event * events;
+	unsigned int n_events;
+	unsigned int events_size;
 };
 
 /*
@@ -160,10 +385,21 @@ unsigned int initialize_proj_arr()
 Initializes a given Proj_arr with default values
 ---
 struct Proj_arr *: struct to initialize
+unsigned int size: number of projectiles to make room for (normally
+		   PROJ_ARR_SZ), more are made room for as needed
 ---
 Returns 1 on success, 0 on fail
 */
-unsigned int initialize_proj_arr( struct Proj_arr * );
+unsigned int initialize_proj_arr( struct Proj_arr *, unsigned int );
+
+/*
+void free_proj_arr()
+---
+Frees the memory allocated to a given Proj_arr
+---
+struct Proj_arr * p: struct to free
+*/
+void free_proj_arr( struct Proj_arr * );
 
 /*
 unsigned int initialize_tilemap()
@@ -177,6 +413,21 @@ Returns 1 on success, 0 on fail
 */
 unsigned int initialize_tilemap( struct Tilemap *,
 				 unsigned int, unsigned int );
+
+/*
+unsigned int initialize_level_tilemap()
+---
+Initializes a given tilemap of a level, allocating it from the level's arena
+so it is freed along with the level
+---
+struct Level * l: level the tilemap belongs to
+struct Tilemap * tm: struct to initialize
+unsigned int r, c: rows and cols of tilemap
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_level_tilemap( struct Level *, struct Tilemap *,
+				       unsigned int, unsigned int );
 	
 /*
 unsigned int initialize_position()
@@ -212,8 +463,8 @@ unsigned int initialize_object ( struct Object *, float, float,
 /*
 unsigned int initialize_level()
 ---
-Initializes a given level with all necessary details about it, along
-with allocating some memory for the dynamic array object_arr.
+Initializes a given level with all necessary details about it, and starts
+the arena everything else allocated for the level comes from.
 ---
 struct Level * l: level to be initialized
 float start_x, start_y: player's starting position
@@ -230,7 +481,8 @@ unsigned int initialize_level ( struct Level *, float, float, float, float,
 /*
 unsigned int add_object_to_level()
 ---
-Adds a struct Object to the object_arr in a given struct Level.
+Adds a struct Object to the object_arr in a given struct Level. The array is
+grown if it is full.
 ---
 struct Level * l: level to be added to
 struct Object o: objecto to be added
@@ -239,11 +491,22 @@ Returns 1 on success, 0 on fail
 */
 unsigned int add_object_to_level ( struct Level *, struct Object );
 
+/*
+void reset_path_cache()
+---
+Empties the path cache of a level, must be called if anything the paths depend
+on changes (objects, wind, gravity, start position)
+---
+struct Level * l: level to reset the path cache of
+*/
+void reset_path_cache( struct Level * );
+
 /*
 unsigned int free_level()
 ---
-Frees the memory allocated to the object array and resets size and
-index of the object array
+Frees everything allocated for a level (object array, tilemaps, grid, path
+cache and the level.bin it was loaded from, if any) with a single reset of its
+arena, and resets size and index of the object array.
 ---
 struct Level * l: level to be freed
 ---
@@ -252,18 +515,129 @@ Returns 1 on success, 0 on fail
 unsigned int free_level ( struct Level * );
 
 /*
-unsigned int add_to_proj_arr()
+unsigned int initialize_grid()
+---
+Builds the collision grid of a level from its object_arr. Must be called again
+if objects are added to the level.
+---
+struct Level * l: level to build the grid for
+unsigned int w, h: no. of cells across and down
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int initialize_grid( struct Level *, unsigned int, unsigned int );
+
+/*
+void initialize_arena()
+---
+Initializes an empty arena, nothing is allocated until it is first used
+---
+struct Arena * a: arena to initialize
+*/
+void initialize_arena( struct Arena * );
+
+/*
+void * arena_alloc()
+---
+Allocates memory from an arena, which stays valid until the arena is reset.
+Memory is aligned to 16 bytes and not cleared.
+---
+struct Arena * a: arena to allocate from
+size_t size: no. of bytes
+---
+Returns a void *, the memory, or NULL on fail
+*/
+void * arena_alloc( struct Arena *, size_t );
+
+/*
+unsigned int arena_add_map()
 ---
-Initializes a new projectile in proj_arr with given values
+Hands a file mapping over to an arena, so it is unmapped when the arena is
+reset
+---
+struct Arena * a: arena to own the mapping
+void * addr: start of the mapping
+size_t len: length of the mapping
+---
+Returns 1 on success, 0 on fail (the mapping is left alone)
+*/
+unsigned int arena_add_map( struct Arena *, void *, size_t );
+
+/*
+void reset_arena()
+---
+Frees every allocation and mapping of an arena at once, leaving it empty and
+ready to be used again
+---
+struct Arena * a: arena to reset
+*/
+void reset_arena( struct Arena * );
+
+/*
+size_t get_arena_peak()
+---
+Gets the most memory any arena has had handed out at once, up to its last
+reset, for sizing ARENA_CHUNK_SZ
+---
+Returns a size_t, no. of bytes
+*/
+size_t get_arena_peak();
+
+/*
+struct Proj_handle add_to_proj_arr()
+---
+Initializes a new projectile in proj_arr with given values, making room for it
+if the arrays are full. Projectiles already in flight are never replaced
 ---
 struct Proj_arr * p: Proj_arr to add to
 struct Position * m: mouse Position
 struct Position s_pos: starting pos of projectile
 ---
-Returns nothing
+Returns a struct Proj_handle of the new projectile, with gen 0 if there was no
+room for it
+*/
+struct Proj_handle add_to_proj_arr( struct Proj_arr *, struct Position *,
+				    struct Position );
+
+/*
+int get_projectile()
+---
+Finds where a projectile is in the arrays of a Proj_arr
+---
+struct Proj_arr * p: Proj_arr to look in
+struct Proj_handle h: handle of the projectile
+---
+Returns an int, index of the projectile, -1 if it has been removed
+*/
+int get_projectile( struct Proj_arr *, struct Proj_handle );
+
+/*
+void remove_from_proj_arr()
+---
+Removes a projectile from a Proj_arr. The last projectile is moved into its
+place, so when looping over the arrays, the same index has to be looked at
+again
+---
+struct Proj_arr * p: Proj_arr to remove from
+unsigned int i: index of the projectile
+*/
+void remove_from_proj_arr( struct Proj_arr *, unsigned int );
+
+/*
+unsigned int add_trigger_event()
+---
+Records a projectile entering a trigger volume, making room for the event if
+needed
+---
+struct Proj_arr * p: Proj_arr the projectile is in
+unsigned int i: index of the projectile
+unsigned int obj: index in object_arr of the trigger
+unsigned int type: type of the trigger
+---
+Returns 1 on success, 0 on fail
 */
-void add_to_proj_arr( struct Proj_arr *, struct Position *,
-			      struct Position );
+unsigned int add_trigger_event( struct Proj_arr *, unsigned int, unsigned int,
+				unsigned int );
 
 /*
 unsigned int free_level()
@@ -280,7 +654,9 @@ void free_tilemap( struct Tilemap * );
 /*
 void reset_proj_arr()
 ---
-Resets a given proj_arr for use when changing levels
+Resets a given proj_arr for use when changing levels. Removes every projectile
+in flight, then puts the free list back in order, so ids are handed out from 0
+again
 ---
 struct Proj_arr * proj_arr: struct to reset
 */
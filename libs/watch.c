@@ -0,0 +1,162 @@
+/**
+watch.c
+---
+File used to store the watcher that lets level files be edited while the game
+runs. The directory of the current level is watched with inotify, and every
+file written there is turned into a CHANGED_* flag for reload_level(). Files
+are only reported once they are closed after writing, or moved into place, so
+a half-saved file is never picked up.
+
+Functions that should not be accessed outside of this file are given the
+keyword 'static'.
+*/
+
+#include "watch.h"
+#include "level.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/*
+unsigned int start_watch()
+---
+Sets up a struct Watch. Only Linux (inotify) is supported, elsewhere the watch
+is left off and never reports any changes.
+---
+struct Watch * w: watch to set up
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_watch( struct Watch * w )
+{
+        w->fd = -1;
+	w->wd = -1;
+#ifdef __linux__
+	w->fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if ( w->fd < 0 ) {
+                fprintf( stderr, "Could not watch level files!\n" );
+		return 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+unsigned int watch_level()
+---
+Points a watch at the directory of a level, instead of whichever level it was
+watching before
+---
+struct Watch * w: watch to use
+int num: number of the level
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int watch_level( struct Watch * w, int num )
+{
+        if ( w->fd < 0 )
+		return 0;
+#ifdef __linux__
+	char loc[32];
+
+	if ( w->wd >= 0 )
+		inotify_rm_watch( w->fd, w->wd );
+	snprintf( loc, 32, "levels/%i", num );
+	w->wd = inotify_add_watch( w->fd, loc, IN_CLOSE_WRITE | IN_MOVED_TO );
+	if ( w->wd < 0 ) {
+                fprintf( stderr, "Could not watch %s!\n", loc );
+		return 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+#ifdef __linux__
+/*
+static unsigned int file_flag()
+---
+Gets the CHANGED_* flag of a file in a level's directory
+---
+const char * name: name of the file
+---
+Returns an unsigned int, the flag, or 0 if it isn't a file of the level
+*/
+static unsigned int file_flag( const char * name )
+{
+        const char * names[4] = { "level.txt", "fg.txt", "bg.txt", "dec.txt" };
+	unsigned int flags[4] = { CHANGED_LEVEL, CHANGED_FG, CHANGED_BG,
+				  CHANGED_DEC };
+
+	for ( int i = 0; i < 4; i++ ) {
+                if ( strcmp( name, names[i] ) == 0 )
+			return flags[i];
+	}
+	return 0;
+}
+#endif
+
+/*
+unsigned int poll_watch()
+---
+Gets which files of the watched level were written since the last call.
+Never blocks.
+---
+struct Watch * w: watch to poll
+---
+Returns an unsigned int, CHANGED_* flags (see level.h) of the files written
+*/
+unsigned int poll_watch( struct Watch * w )
+{
+        unsigned int changed = 0;
+	if ( w->fd < 0 || w->wd < 0 )
+		return 0;
+#ifdef __linux__
+	char buf[4096]
+		__attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	struct inotify_event * ev;
+	ssize_t len;
+
+	while ( ( len = read( w->fd, buf, sizeof( buf ) ) ) > 0 ) {
+                for ( char * p = buf; p < buf + len;
+		      p += sizeof( struct inotify_event ) + ev->len ) {
+                        ev = (struct inotify_event *)p;
+			/* events were dropped, so reload the lot */
+			if ( ev->mask & IN_Q_OVERFLOW )
+				changed |= CHANGED_LEVEL | CHANGED_FG |
+					   CHANGED_BG | CHANGED_DEC;
+			else if ( ev->wd == w->wd && ev->len > 0 )
+				changed |= file_flag( ev->name );
+		}
+	}
+	if ( len < 0 && errno != EAGAIN )
+		fprintf( stderr, "Could not read level file changes!\n" );
+#endif
+	return changed;
+}
+
+/*
+void stop_watch()
+---
+Stops a watch and frees what it holds
+---
+struct Watch * w: watch to stop
+*/
+void stop_watch( struct Watch * w )
+{
+#ifdef __linux__
+	if ( w->fd >= 0 )
+		close( w->fd );
+#endif
+	w->fd = -1;
+	w->wd = -1;
+}
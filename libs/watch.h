@@ -0,0 +1,70 @@
+#ifndef WATCH_H_
+#define WATCH_H_
+
+/**
+watch.h
+---
+Header file for watch.c, used to store all accessible functions related to
+watching the files of the current level for changes
+*/
+
+/**
+struct Watch
+---
+Watches the directory of one level for files being written
+---
+int fd: inotify instance, -1 if watching isn't available
+int wd: watch on the level's directory, -1 if none
+*/
+struct Watch {
+        int fd;
+	int wd;
+};
+
+/*
+unsigned int start_watch()
+---
+Sets up a struct Watch. Only Linux (inotify) is supported, elsewhere the watch
+is left off and never reports any changes.
+---
+struct Watch * w: watch to set up
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int start_watch( struct Watch * );
+
+/*
+unsigned int watch_level()
+---
+Points a watch at the directory of a level, instead of whichever level it was
+watching before
+---
+struct Watch * w: watch to use
+int num: number of the level
+---
+Returns 1 on success, 0 on fail
+*/
+unsigned int watch_level( struct Watch *, int );
+
+/*
+unsigned int poll_watch()
+---
+Gets which files of the watched level were written since the last call.
+Never blocks.
+---
+struct Watch * w: watch to poll
+---
+Returns an unsigned int, CHANGED_* flags (see level.h) of the files written
+*/
+unsigned int poll_watch( struct Watch * );
+
+/*
+void stop_watch()
+---
+Stops a watch and frees what it holds
+---
+struct Watch * w: watch to stop
+*/
+void stop_watch( struct Watch * );
+
+#endif //WATCH_H_
@@ -0,0 +1,119 @@
+/**
+levelc.c
+---
+Level compiler. Packs the text files of a level (level.txt, fg.txt, bg.txt and
+dec.txt) into a single levels/N/level.bin, which load_level() uses instead of
+the text files as long as it is newer than all of them. See struct
+Level_header for the layout.
+
+Each level.bin is loaded back once written and compared against the text
+files, so a bad file is never left behind.
+
+Must be run from the root of the repo, like the game.
+
+Build with 'make levelc', run with
+./levelc [level ...]
+---
+level: levels to compile (default, every level)
+*/
+
+#include "../libs/level.h"
+#include "../libs/structures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+static unsigned int same_level()
+---
+Checks that two loaded levels hold the same data
+---
+struct Level * a, * b: levels to compare
+---
+Returns an unsigned int, 1 if the same, 0 if not
+*/
+static unsigned int same_level( struct Level * a, struct Level * b )
+{
+        struct Tilemap * ta[3] = { &a->fg, &a->bg, &a->dec };
+	struct Tilemap * tb[3] = { &b->fg, &b->bg, &b->dec };
+
+	if ( a->index != b->index ||
+	     memcmp( a->object_arr, b->object_arr,
+		     a->index * sizeof( struct Object ) ) != 0 ||
+	     memcmp( &a->start_pos, &b->start_pos,
+		     sizeof( struct Position ) ) != 0 ||
+	     memcmp( &a->target_pos, &b->target_pos,
+		     sizeof( struct Position ) ) != 0 ||
+	     memcmp( &a->wind, &b->wind, sizeof( struct Position ) ) != 0 ||
+	     memcmp( &a->gravity, &b->gravity,
+		     sizeof( struct Position ) ) != 0 )
+		return 0;
+	for ( int i = 0; i < 3; i++ ) {
+                if ( ta[i]->size != tb[i]->size ||
+		     memcmp( ta[i]->map, tb[i]->map, ta[i]->size ) != 0 )
+			return 0;
+	}
+	return 1;
+}
+
+/*
+static unsigned int compile_level()
+---
+Compiles the text files of a level into its level.bin, then checks the
+level.bin loads back the same
+---
+int num: number of the level
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int compile_level( int num )
+{
+        struct Level txt, bin;
+	char loc[32];
+	unsigned int loaded, ok;
+
+	snprintf( loc, 32, "levels/%i/level.bin", num );
+
+	load_level_txt( &txt, num );
+	if ( !write_level_bin( &txt, loc ) ) {
+                free_level( &txt );
+		return 0;
+	}
+
+	loaded = load_level_bin( loc, &bin, num );
+	ok = loaded && same_level( &txt, &bin );
+	if ( ok )
+		printf( "%s: %u objects, %ux%u tiles\n", loc, bin.index,
+			bin.fg.rows, bin.fg.cols );
+	else {
+                fprintf( stderr, "%s did not load back the same!\n", loc );
+		remove( loc );
+	}
+
+	free_level( &txt );
+	if ( loaded )
+		free_level( &bin );
+	return ok;
+}
+
+int main( int argc, char ** argv )
+{
+        unsigned int ok = 1;
+	
+        if ( argc > 1 ) {
+                for ( int i = 1; i < argc; i++ ) {
+                        int num = strtol( argv[i], NULL, 10 );
+			if ( num < 1 || num > LAST_LEVEL ) {
+                                fprintf( stderr, "No level %s!\n", argv[i] );
+				ok = 0;
+				continue;
+			}
+			ok = compile_level( num ) && ok;
+		}
+	} else {
+                for ( int num = 1; num <= LAST_LEVEL; num++ )
+			ok = compile_level( num ) && ok;
+	}
+	return ok ? 0 : 1;
+}
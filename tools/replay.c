@@ -0,0 +1,123 @@
+/**
+replay.c
+---
+Tool that plays back a replay recorded by the game (see ./main -r), headless
+and as fast as it can go. Every tick is run by game_tick(), the same as the
+game, with the inputs of the replay used on the ticks they were recorded on.
+The game is checked against the replay along the way, so a replay that no
+longer plays out the same (after a change to the physics, say) is caught, with
+the tick it first went wrong on. Playing the same replay a few times makes for
+a repeatable performance run of the whole game.
+
+Must be run from the root of the repo, like the game, and built with the same
+COLL_MODE as the replay was recorded with.
+
+Build with 'make replay', run with
+./replay [-n runs] file
+---
+-n runs: no. of times to play the replay (default, 1), the fastest is reported
+file: replay file to play
+*/
+
+#include "../libs/game.h"
+#include "../libs/replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+static double now()
+---
+Gets the current time from a monotonic clock
+---
+Returns a double, time in seconds
+*/
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+static unsigned int play()
+---
+Plays a replay through once, from the start
+---
+struct Replay * r: replay to play
+struct Game * g: game to play it on
+double * elapsed: time taken to play it (s)
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int play( struct Replay * r, struct Game * g,
+			  double * elapsed )
+{
+        if ( !initialize_game( g, r->head.level ) )
+		return 0;
+	r->next = 0;
+	r->checks = 0;
+	r->desyncs = 0;
+	r->first_desync = 0;
+	g->play = r;
+
+	double start = now();
+	while ( g->play != NULL )
+		game_tick( g );
+	*elapsed = now() - start;
+	return 1;
+}
+
+int main( int argc, char ** argv )
+{
+        static struct Game g;
+	struct Replay r;
+	unsigned int runs = 1;
+	double best = 0, elapsed;
+	int opt;
+
+	while ( ( opt = getopt( argc, argv, "n:" ) ) != -1 ) {
+                switch ( opt ) {
+		case 'n':
+			runs = strtoul( optarg, NULL, 10 );
+			break;
+		default:
+			fprintf( stderr, "usage: %s [-n runs] file\n", argv[0] );
+			return 1;
+		}
+	}
+	if ( optind != argc - 1 || runs == 0 ) {
+                fprintf( stderr, "usage: %s [-n runs] file\n", argv[0] );
+		return 1;
+	}
+	if ( !load_replay( &r, argv[optind] ) )
+		return 1;
+
+	printf( "%s: %u records from level %u, COLL_MODE=%u\n", argv[optind],
+		r.count, r.head.level, r.head.coll_mode );
+	for ( unsigned int i = 0; i < runs; i++ ) {
+                if ( !play( &r, &g, &elapsed ) ) {
+                        free_replay( &r );
+			return 1;
+		}
+		if ( i == 0 || elapsed < best )
+			best = elapsed;
+		if ( i < runs - 1 )
+			free_game( &g );
+	}
+
+	printf( "level %u, score %u after %lu ticks\n", g.curr_level, g.score,
+		g.ticks );
+	printf( "%u checks, %u desyncs", r.checks, r.desyncs );
+	if ( r.desyncs )
+		printf( ", first desync at tick %u", r.first_desync );
+	printf( "\n%lu ticks in %.3fs (best of %u), %.0f ticks/s\n", g.ticks,
+		best, runs, g.ticks / best );
+
+	unsigned int ok = r.desyncs == 0;
+	free_game( &g );
+	free_replay( &r );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,496 @@
+/**
+solver.c
+---
+Tool that finds every one-arrow solution for the levels in levels/. The aim
+space (every mouse position in the window, snapped to a grid) is swept, with
+each throw simulated by the same code the game uses (add_to_proj_arr(),
+simulate_step() and its trigger events). Every aim that hits the target is
+reported. The window shows the part of the level the player starts in view
+of (see reset_camera()), so aims are in that view, as they are in the game.
+
+The sweep is split into tasks of AIMS_PER_TASK aims. Each worker thread owns a
+deque of tasks, taking from the bottom of its own, and steals from the top of
+another worker's deque once its own runs dry. Throws that hit a wall straight
+away are much cheaper than ones that bounce around, so some parts of the sweep
+finish far sooner than others.
+
+Must be run from the root of the repo, like the game.
+
+Build with 'make solver', run with
+./solver [-t threads] [-s step] [-q] [level ...]
+---
+-t threads: no. of worker threads (default, one per core)
+-s step: spacing of the aim grid in px (default, 4)
+-q: only print the no. of hits per level, not every aim
+level: levels to solve (default, every level)
+*/
+
+#include "../libs/game.h"
+#include "../libs/level.h"
+#include "../libs/physics.h"
+#include "../libs/structures.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AIMS_PER_TASK (64) /* also the size of each worker's Proj_arr */
+#define MAX_TICKS (1200)   /* ticks before a throw is given up on (20s) */
+
+/**
+struct Task
+---
+A block of aims in one level for a worker to simulate
+---
+unsigned int level: index of the level in the solver
+unsigned int first: index of the first aim
+unsigned int count: no. of aims
+*/
+struct Task {
+        unsigned int level;
+	unsigned int first;
+	unsigned int count;
+};
+
+/**
+struct Deque
+---
+Double ended queue of tasks owned by one worker. The owner takes from the
+bottom, thieves take from the top.
+---
+pthread_mutex_t lock: held while changing top or bottom
+struct Task * tasks: task storage
+unsigned int top: index of the oldest task
+unsigned int bottom: index after the newest task
+*/
+struct Deque {
+        pthread_mutex_t lock;
+	struct Task * tasks;
+	unsigned int top;
+	unsigned int bottom;
+};
+
+/**
+struct Solver
+---
+State shared between every worker
+---
+struct Level * levels: levels being solved
+struct Camera * views: part of each level in view while aiming
+unsigned int * nums: level number of each level
+unsigned char ** hits: per level, 1 for each aim that hit the target
+unsigned int n_levels: no. of levels
+unsigned int step: spacing of the aim grid
+unsigned int cols, rows: size of the aim grid
+struct Deque * deques: one deque per worker
+unsigned int n_workers: no. of workers
+*/
+struct Solver {
+        struct Level * levels;
+	struct Camera * views;
+	unsigned int * nums;
+	unsigned char ** hits;
+	unsigned int n_levels;
+	unsigned int step;
+	unsigned int cols;
+	unsigned int rows;
+	struct Deque * deques;
+	unsigned int n_workers;
+};
+
+/**
+struct Worker
+---
+State of a single worker thread
+---
+struct Solver * s: shared solver state
+unsigned int id: index of the worker's deque
+unsigned long long throws: no. of throws simulated
+unsigned long long ticks: no. of ticks simulated (over all throws)
+unsigned int steals: no. of tasks stolen from other workers
+*/
+struct Worker {
+        struct Solver * s;
+	unsigned int id;
+	unsigned long long throws;
+	unsigned long long ticks;
+	unsigned int steals;
+};
+
+/*
+static double now()
+---
+Gets the current time from a monotonic clock
+---
+Returns a double, time in seconds
+*/
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+static unsigned int pop_task()
+---
+Takes the newest task from the bottom of a worker's own deque
+---
+struct Deque * d: deque to take from
+struct Task * t: task taken
+---
+Returns 1 if a task was taken, 0 if the deque was empty
+*/
+static unsigned int pop_task( struct Deque * d, struct Task * t )
+{
+        unsigned int got = 0;
+	pthread_mutex_lock( &d->lock );
+	if ( d->bottom > d->top ) {
+                *t = d->tasks[--d->bottom];
+		got = 1;
+	}
+	pthread_mutex_unlock( &d->lock );
+	return got;
+}
+
+/*
+static unsigned int steal_task()
+---
+Takes the oldest task from the top of another worker's deque
+---
+struct Deque * d: deque to steal from
+struct Task * t: task taken
+---
+Returns 1 if a task was taken, 0 if the deque was empty
+*/
+static unsigned int steal_task( struct Deque * d, struct Task * t )
+{
+        unsigned int got = 0;
+	pthread_mutex_lock( &d->lock );
+	if ( d->bottom > d->top ) {
+                *t = d->tasks[d->top++];
+		got = 1;
+	}
+	pthread_mutex_unlock( &d->lock );
+	return got;
+}
+
+/*
+static void aim_position()
+---
+Gets where an aim of the grid is in a level, the same way the game turns a
+mouse position in the window into one in the level and snaps it when firing
+---
+struct Solver * s: solver the aim is in
+unsigned int level: index of the level in the solver
+unsigned int a: index of the aim
+struct Position * mouse: where to store the position
+*/
+static void aim_position( struct Solver * s, unsigned int level,
+			  unsigned int a, struct Position * mouse )
+{
+        struct Camera * v = &s->views[level];
+	initialize_position( mouse, ( a % s->cols ) * s->step + floorf( v->x ),
+			     ( a / s->cols ) * s->step + floorf( v->y ) );
+	snap_aim( mouse );
+}
+
+/*
+static void run_task()
+---
+Throws every aim in a task at once and records which hit the target. Each
+throw is stepped until it hits the target, gets stuck or runs out of ticks.
+---
+struct Worker * w: worker running the task
+struct Proj_arr * p: worker's projectiles, AIMS_PER_TASK in size
+struct Task * t: task to run
+*/
+static void run_task( struct Worker * w, struct Proj_arr * p,
+		      struct Task * t )
+{
+        struct Solver * s = w->s;
+	struct Level * l = &s->levels[t->level];
+	unsigned int aim[AIMS_PER_TASK];
+	struct Position mouse;
+
+	reset_proj_arr( p );
+	for ( unsigned int i = 0; i < t->count; i++ ) {
+                unsigned int a = t->first + i;
+		aim_position( s, t->level, a, &mouse );
+		/* ids start from 0 after a reset, so stay below
+		   AIMS_PER_TASK */
+		aim[add_to_proj_arr( p, &mouse, l->start_pos ).id] = a;
+	}
+
+	unsigned int left = p->count;
+	for ( unsigned int tick = 0; tick < MAX_TICKS && left > 0; tick++ ) {
+                simulate_step( l, p, TIME_INC );
+		w->ticks += left;
+
+		for ( unsigned int e = 0; e < p->n_events; e++ ) {
+                        struct Trigger_event * ev = &p->events[e];
+			int i = get_projectile( p, ev->proj );
+			if ( ev->type != OBJ_TARGET || i < 0 )
+				continue;
+			s->hits[t->level][aim[ev->proj.id]] = 1;
+			remove_from_proj_arr( p, i );
+		}
+		left = p->count;
+	}
+	w->throws += t->count;
+}
+
+/*
+static void * work()
+---
+Entrypoint of each worker thread. Runs tasks from its own deque, then steals
+from the others until every deque is empty.
+---
+void * arg: struct Worker * of the thread
+---
+Returns NULL
+*/
+static void * work( void * arg )
+{
+        struct Worker * w = arg;
+	struct Solver * s = w->s;
+	struct Proj_arr p;
+	struct Task t;
+
+	if ( !initialize_proj_arr( &p, AIMS_PER_TASK ) )
+		return NULL;
+
+	while ( 1 ) {
+                if ( pop_task( &s->deques[w->id], &t ) ) {
+                        run_task( w, &p, &t );
+			continue;
+		}
+
+		/* own deque is empty, try everyone else once */
+		unsigned int stolen = 0;
+		for ( unsigned int v = 1; v < s->n_workers && !stolen; v++ ) {
+                        unsigned int victim = ( w->id + v ) % s->n_workers;
+			stolen = steal_task( &s->deques[victim], &t );
+		}
+		/* tasks are never added once started, so nothing is left */
+		if ( !stolen )
+			break;
+		w->steals++;
+		run_task( w, &p, &t );
+	}
+	free_proj_arr( &p );
+	return NULL;
+}
+
+/*
+static unsigned int load_levels()
+---
+Loads the levels to solve, the same way the game does, along with the view of
+each that the player aims in
+---
+struct Solver * s: solver with nums and n_levels set
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int load_levels( struct Solver * s )
+{
+        unsigned int aims = s->cols * s->rows;
+
+        s->levels = malloc( sizeof( struct Level ) * s->n_levels );
+	s->views = malloc( sizeof( struct Camera ) * s->n_levels );
+	s->hits = malloc( sizeof( unsigned char * ) * s->n_levels );
+	if ( s->levels == NULL || s->views == NULL || s->hits == NULL ) {
+                fprintf( stderr, "Could not allocate levels!\n" );
+		return 0;
+	}
+	for ( unsigned int i = 0; i < s->n_levels; i++ ) {
+                struct Level * l = &s->levels[i];
+		load_level( l, s->nums[i] );
+		reset_camera( &s->views[i], l );
+
+		s->hits[i] = calloc( aims, 1 );
+		if ( s->hits[i] == NULL ) {
+                        fprintf( stderr, "Could not allocate hits!\n" );
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+static unsigned int make_deques()
+---
+Splits every level's aims into tasks and deals them out to the workers in
+contiguous blocks, so neighbouring aims (which tend to cost the same) start on
+the same worker and any imbalance is left to stealing
+---
+struct Solver * s: solver to make deques for
+---
+Returns 1 on success, 0 on fail
+*/
+static unsigned int make_deques( struct Solver * s )
+{
+        unsigned int aims = s->cols * s->rows;
+	unsigned int per_level = ( aims + AIMS_PER_TASK - 1 ) / AIMS_PER_TASK;
+	unsigned int total = per_level * s->n_levels;
+	unsigned int per_worker = ( total + s->n_workers - 1 ) / s->n_workers;
+
+	s->deques = calloc( s->n_workers, sizeof( struct Deque ) );
+	if ( s->deques == NULL ) {
+                fprintf( stderr, "Could not allocate deques!\n" );
+		return 0;
+	}
+	for ( unsigned int w = 0; w < s->n_workers; w++ ) {
+                struct Deque * d = &s->deques[w];
+		pthread_mutex_init( &d->lock, NULL );
+		d->tasks = malloc( sizeof( struct Task ) * per_worker );
+		if ( d->tasks == NULL ) {
+                        fprintf( stderr, "Could not allocate deques!\n" );
+			return 0;
+		}
+	}
+
+	for ( unsigned int i = 0; i < total; i++ ) {
+                /* pushed in reverse, so each worker pops its block in order */
+                unsigned int n = total - 1 - i;
+                struct Deque * d = &s->deques[n / per_worker];
+		struct Task * t = &d->tasks[d->bottom++];
+		t->level = n / per_level;
+		t->first = ( n % per_level ) * AIMS_PER_TASK;
+		t->count = aims - t->first;
+		if ( t->count > AIMS_PER_TASK )
+			t->count = AIMS_PER_TASK;
+	}
+	return 1;
+}
+
+/*
+static void print_hits()
+---
+Prints the aims that hit the target in each level, as mouse positions in the
+window and in the level
+---
+struct Solver * s: solver to print the results of
+unsigned int quiet: 1 to only print the no. of hits
+*/
+static void print_hits( struct Solver * s, unsigned int quiet )
+{
+        unsigned int aims = s->cols * s->rows;
+	struct Position mouse;
+
+        for ( unsigned int i = 0; i < s->n_levels; i++ ) {
+                unsigned int n = 0;
+		for ( unsigned int a = 0; a < aims; a++ )
+			n += s->hits[i][a];
+
+		printf( "level %u: %u of %u aims hit\n", s->nums[i], n, aims );
+		if ( quiet )
+			continue;
+		for ( unsigned int a = 0; a < aims; a++ ) {
+                        if ( !s->hits[i][a] )
+				continue;
+			aim_position( s, i, a, &mouse );
+			printf( "  mouse %u,%u (%.0f,%.0f in the level)\n",
+				( a % s->cols ) * s->step,
+				( a / s->cols ) * s->step, mouse.x, mouse.y );
+		}
+	}
+}
+
+int main( int argc, char ** argv )
+{
+        struct Solver s;
+	unsigned int quiet = 0;
+	int opt;
+	long cores = sysconf( _SC_NPROCESSORS_ONLN );
+
+	s.n_workers = cores > 0 ? cores : 1;
+	s.step = 4;
+	while ( ( opt = getopt( argc, argv, "t:s:q" ) ) != -1 ) {
+                switch ( opt ) {
+		case 't':
+			s.n_workers = strtoul( optarg, NULL, 10 );
+			break;
+		case 's':
+			s.step = strtoul( optarg, NULL, 10 );
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			fprintf( stderr, "usage: %s [-t threads] [-s step] [-q] "
+				 "[level ...]\n", argv[0] );
+			return 1;
+		}
+	}
+	if ( s.n_workers == 0 || s.step == 0 ) {
+                fprintf( stderr, "threads and step must be at least 1\n" );
+		return 1;
+	}
+	s.cols = ( VIEW_W + s.step - 1 ) / s.step;
+	s.rows = ( VIEW_H + s.step - 1 ) / s.step;
+
+	/* levels given, or every level */
+	s.n_levels = argc > optind ? argc - optind : LAST_LEVEL;
+	s.nums = malloc( sizeof( unsigned int ) * s.n_levels );
+	if ( s.nums == NULL )
+		return 1;
+	for ( unsigned int i = 0; i < s.n_levels; i++ ) {
+                s.nums[i] = argc > optind ?
+			    strtoul( argv[optind + i], NULL, 10 ) : i + 1;
+		if ( s.nums[i] < 1 || s.nums[i] > LAST_LEVEL ) {
+                        fprintf( stderr, "No level %u!\n", s.nums[i] );
+			return 1;
+		}
+	}
+
+	if ( !load_levels( &s ) || !make_deques( &s ) )
+		return 1;
+
+	struct Worker * workers = calloc( s.n_workers, sizeof( struct Worker ) );
+	pthread_t * threads = malloc( sizeof( pthread_t ) * s.n_workers );
+	if ( workers == NULL || threads == NULL )
+		return 1;
+
+	double start = now();
+	for ( unsigned int w = 0; w < s.n_workers; w++ ) {
+                workers[w].s = &s;
+		workers[w].id = w;
+		pthread_create( &threads[w], NULL, work, &workers[w] );
+	}
+	unsigned long long throws = 0, ticks = 0;
+	unsigned int steals = 0;
+	for ( unsigned int w = 0; w < s.n_workers; w++ ) {
+                pthread_join( threads[w], NULL );
+		throws += workers[w].throws;
+		ticks += workers[w].ticks;
+		steals += workers[w].steals;
+	}
+	double elapsed = now() - start;
+
+	print_hits( &s, quiet );
+	printf( "%llu trajectories (%llu ticks) in %.3fs on %u threads, "
+		"%u tasks stolen\n", throws, ticks, elapsed, s.n_workers,
+		steals );
+	printf( "%.0f trajectories/s\n", throws / elapsed );
+
+	/* free all dynamically allocated stuff */
+	for ( unsigned int i = 0; i < s.n_levels; i++ ) {
+                free_level( &s.levels[i] );
+		free( s.hits[i] );
+	}
+	for ( unsigned int w = 0; w < s.n_workers; w++ ) {
+                pthread_mutex_destroy( &s.deques[w].lock );
+		free( s.deques[w].tasks );
+	}
+	free( s.deques );
+	free( s.levels );
+	free( s.views );
+	free( s.hits );
+	free( s.nums );
+	free( workers );
+	free( threads );
+	return 0;
+}